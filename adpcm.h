@@ -0,0 +1,79 @@
+/* adpcm.h
+ * IMA ADPCM, which stores each sample as a 4 bit step up or down from the
+ * last one - the size of the steps adapts as the sound gets louder or
+ * quieter, so it follows the 8 bit sound closely at a quarter of the size
+ *
+ * this is shared by the game, which decodes, and tools/raw2adpcm.c, which
+ * encodes, so both always agree on exactly what a nibble decodes to */
+
+#ifndef ADPCM_H
+#define ADPCM_H
+
+/* how big a step each of the 89 step sizes is */
+static const short adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/* how the step size changes after each nibble, small steps shrink it and
+ * large ones grow it */
+static const signed char adpcm_step_change[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+/* where the decoder is up to, both start at 0 at the beginning of a sound */
+struct AdpcmState {
+    int sample;     /* the last sample, 16 bit */
+    int step;       /* index into adpcm_steps */
+};
+
+/* decode one nibble, returning the new 16 bit sample */
+static inline int adpcm_decode(struct AdpcmState* state, int nibble) {
+    int step = adpcm_steps[state->step];
+
+    /* the nibble is a sign bit and three bits of step, 4, 2 and 1 */
+    int difference = step >> 3;
+    if (nibble & 4) {
+        difference += step;
+    }
+    if (nibble & 2) {
+        difference += step >> 1;
+    }
+    if (nibble & 1) {
+        difference += step >> 2;
+    }
+
+    int sample = state->sample;
+    if (nibble & 8) {
+        sample -= difference;
+        if (sample < -32768) {
+            sample = -32768;
+        }
+    } else {
+        sample += difference;
+        if (sample > 32767) {
+            sample = 32767;
+        }
+    }
+    state->sample = sample;
+
+    int index = state->step + adpcm_step_change[nibble];
+    if (index < 0) {
+        index = 0;
+    } else if (index > 88) {
+        index = 88;
+    }
+    state->step = index;
+
+    return sample;
+}
+
+#endif
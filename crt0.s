@@ -0,0 +1,87 @@
+@ Startup code for the GBA cartridge, used along with gba.ld
+@ it holds the cartridge header, sets up the stacks, copies the IWRAM and
+@ EWRAM sections out of ROM, zeroes .bss and then calls main
+
+	.section .crt0, "ax", %progbits
+	.arm
+	.align 2
+
+	.global _start
+	.type _start, %function
+
+_start:
+	@ the first instruction of the header jumps over the rest of it
+	b .start
+
+	@ Nintendo logo, title, game code and checksum - these are left zeroed
+	@ here and filled in afterwards by gbafix
+	.fill 156, 1, 0
+	.ascii "DEFENDER    "
+	.ascii "DFND"
+	.ascii "01"
+	.byte 0x96		@ fixed value
+	.byte 0x00		@ main unit code
+	.byte 0x00		@ device type
+	.fill 7, 1, 0		@ reserved
+	.byte 0x00		@ software version
+	.byte 0x00		@ header checksum
+	.fill 2, 1, 0		@ reserved
+
+.start:
+	@ irq mode stack
+	mov r0, #0x12
+	msr cpsr_c, r0
+	ldr sp, =__sp_irq
+
+	@ system mode stack, shared with user mode, this is what main runs in
+	mov r0, #0x1f
+	msr cpsr_c, r0
+	ldr sp, =__sp_usr
+
+	@ copy the hot code and initialized data into IWRAM
+	ldr r0, =__iwram_load
+	ldr r1, =__iwram_start
+	ldr r2, =__iwram_end
+	bl .copy
+
+	@ copy the EWRAM section
+	ldr r0, =__ewram_load
+	ldr r1, =__ewram_start
+	ldr r2, =__ewram_end
+	bl .copy
+
+	@ zero the .bss sections
+	ldr r1, =__bss_start
+	ldr r2, =__bss_end
+	bl .zero
+	ldr r1, =__ewram_bss_start
+	ldr r2, =__ewram_bss_end
+	bl .zero
+
+	@ main may be Thumb code, so switch with bx
+	ldr r0, =main
+	mov lr, pc
+	bx r0
+
+	@ main shouldn't return, but if it does just stop here
+.hang:
+	b .hang
+
+	@ copy words from r0 to r1 until r1 reaches r2
+.copy:
+	cmp r1, r2
+	ldrlo r3, [r0], #4
+	strlo r3, [r1], #4
+	blo .copy
+	bx lr
+
+	@ write zero words from r1 until r1 reaches r2
+.zero:
+	mov r0, #0
+.zeroloop:
+	cmp r1, r2
+	strlo r0, [r1], #4
+	blo .zeroloop
+	bx lr
+
+	.ltorg
@@ -0,0 +1,57 @@
+/* fastdiv.h
+ * division and modulo by constants without the divide routine - the ARM7 has
+ * no divide instruction, so a / or % turns into a call that loops over the
+ * bits, while these take a long multiply and a couple of adds */
+
+#ifndef FASTDIV_H
+#define FASTDIV_H
+
+#include "fixed.h"
+#include "sections.h"
+
+/* divide n by the constant d, reciprocal must be FIXED_RECIPROCAL(d)
+ * multiplying by the reciprocal can come out one too low, never more, so a
+ * single correction step makes the answer exact for every 32 bit n */
+static inline unsigned int fast_div(unsigned int n, unsigned int d, unsigned int reciprocal) {
+    unsigned int q = fixed_mul_high(n, reciprocal);
+    if (n - q * d >= d) {
+        q++;
+    }
+    return q;
+}
+
+/* the remainder of n divided by the constant d, same reciprocal as above */
+static inline unsigned int fast_mod(unsigned int n, unsigned int d, unsigned int reciprocal) {
+    unsigned int r = n - fixed_mul_high(n, reciprocal) * d;
+    if (r >= d) {
+        r -= d;
+    }
+    return r;
+}
+
+/* the usual way to call these, d has to be a constant so the reciprocal
+ * gets worked out by the compiler */
+#define FAST_DIV(n, d) fast_div((n), (d), FIXED_RECIPROCAL(d))
+#define FAST_MOD(n, d) fast_mod((n), (d), FIXED_RECIPROCAL(d))
+
+/* random number generator from xorshift.s */
+FAR_CALL void xorshift(unsigned int*);
+
+/* a random number in [0, range) from the xorshift generator
+ * seed % range favors the small numbers whenever range doesn't divide 2^32,
+ * so this takes the top of seed * range instead and draws again in the rare
+ * case the value lands in the uneven part (Lemire's method) - when range is
+ * a constant the threshold below is worked out by the compiler */
+static inline unsigned int random_range(unsigned int* seed, unsigned int range) {
+    unsigned int threshold = (0u - range) % range;
+    unsigned long long product;
+
+    do {
+        xorshift(seed);
+        product = (unsigned long long) *seed * range;
+    } while ((unsigned int) product < threshold);
+
+    return (unsigned int) (product >> 32);
+}
+
+#endif
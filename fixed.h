@@ -0,0 +1,67 @@
+/* fixed.h
+ * fixed point math, since the GBA has no floating point hardware and every
+ * float operation turns into a slow library call */
+
+#ifndef FIXED_H
+#define FIXED_H
+
+/* 8.8 fixed point, the format used for sprite positions (x << 8) */
+typedef int fixed8;
+
+/* 16.16 fixed point, for when 8 fractional bits aren't enough */
+typedef int fixed16;
+
+/* turn a constant like 0.25 into fixed point - the compiler folds these
+ * into plain integers so no float code ends up in the program, they must
+ * only ever be given constants */
+#define FIXED8(value) ((fixed8) ((value) * 256))
+#define FIXED16(value) ((fixed16) ((value) * 65536))
+
+/* the fraction 1/divisor as a 0.32 fixed point constant, for use with
+ * fixed_mul_high to divide by a constant without calling the divide routine */
+#define FIXED_RECIPROCAL(divisor) ((unsigned int) (0xffffffffu / (divisor)))
+
+/* conversions between whole numbers and fixed point, going to int rounds
+ * down (towards negative infinity) */
+static inline fixed8 int_to_fixed8(int value) {
+    return value << 8;
+}
+
+static inline int fixed8_to_int(fixed8 value) {
+    return value >> 8;
+}
+
+static inline fixed16 int_to_fixed16(int value) {
+    return value << 16;
+}
+
+static inline int fixed16_to_int(fixed16 value) {
+    return value >> 16;
+}
+
+static inline fixed16 fixed8_to_fixed16(fixed8 value) {
+    return value << 8;
+}
+
+static inline fixed8 fixed16_to_fixed8(fixed16 value) {
+    return value >> 8;
+}
+
+/* multiply two fixed point numbers, the product of two 8.8 numbers has 16
+ * fractional bits so shift the extra ones back out */
+static inline fixed8 fixed8_mul(fixed8 a, fixed8 b) {
+    return (a * b) >> 8;
+}
+
+/* 16.16 products need 64 bits, which the ARM does in one long multiply */
+static inline fixed16 fixed16_mul(fixed16 a, fixed16 b) {
+    return (fixed16) (((long long) a * b) >> 16);
+}
+
+/* the top 32 bits of a 32x32 bit product, used with FIXED_RECIPROCAL this
+ * divides value by a constant (rounding down, exact to within one) */
+static inline unsigned int fixed_mul_high(unsigned int value, unsigned int reciprocal) {
+    return (unsigned int) (((unsigned long long) value * reciprocal) >> 32);
+}
+
+#endif
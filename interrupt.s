@@ -0,0 +1,84 @@
+@ Master interrupt handler
+@ the BIOS jumps here in IRQ mode (ARM state) through the address stored at
+@ 0x3007FFC, with r0-r3, r12 and lr already saved on the IRQ stack
+@
+@ it picks the highest priority (lowest numbered) interrupt which is both
+@ enabled and pending, acknowledges just that one in REG_IF and the BIOS copy
+@ of it, then calls its entry in interrupt_handlers in system mode, so the
+@ handler gets the big user stack - any other pending interrupts fire again
+@ as soon as this returns
+@
+@ sources set in interrupt_nest_mask (like HBlank) are left enabled while
+@ the handler runs, so they can interrupt it
+
+.section .iwram, "ax", %progbits
+.arm
+.align 2
+.global interrupt_master
+.type interrupt_master, %function
+
+interrupt_master:
+	@ REG_IE is in the low half and REG_IF in the high half of this word
+	ldr r0, =0x04000200
+	ldr r1, [r0]
+	and r1, r1, r1, lsr #16
+
+	@ look for the lowest set bit, stepping through the handler table with it
+	ldr r2, =interrupt_handlers
+	mov r3, #1
+.find:
+	tst r1, r3
+	bne .found
+	add r2, r2, #4
+	mov r3, r3, lsl #1
+	cmp r3, #0x4000
+	blo .find
+
+	@ nothing was pending
+	bx lr
+
+.found:
+	@ acknowledge it, writing a 1 to REG_IF clears that bit
+	strh r3, [r0, #2]
+
+	@ and tell the BIOS, which VBlankIntrWait needs
+	ldr r1, =0x03007ff8
+	ldrh r12, [r1]
+	orr r12, r12, r3
+	strh r12, [r1]
+
+	@ nothing to call if there's no handler
+	ldr r2, [r2]
+	cmp r2, #0
+	bxeq lr
+
+	@ only let the nesting sources in while the handler runs, never itself
+	ldrh r12, [r0]
+	ldr r1, =interrupt_nest_mask
+	ldrh r1, [r1]
+	bic r1, r1, r3
+	and r1, r1, r12
+	strh r1, [r0]
+
+	@ save the register address, spsr, old REG_IE and where to return to
+	mrs r3, spsr
+	stmfd sp!, {r0, r3, r12, lr}
+
+	@ switch to system mode with interrupts on and call the handler
+	mov r3, #0x1f
+	msr cpsr_c, r3
+	stmfd sp!, {r3, lr}
+	mov lr, pc
+	bx r2
+	ldmfd sp!, {r3, lr}
+
+	@ back to irq mode with interrupts off
+	mov r3, #0x92
+	msr cpsr_c, r3
+	ldmfd sp!, {r0, r3, r12, lr}
+	msr spsr_cf, r3
+	strh r12, [r0]
+
+	bx lr
+
+	.ltorg
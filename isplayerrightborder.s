@@ -1,6 +1,10 @@
 @Assembly function for determing if the player is at the right border
 
+.text
+.arm
+.align 2
 .global is_player_right_border
+.type is_player_right_border, %function
 
 is_player_right_border:
 	@left shift x position by eight
@@ -23,4 +27,4 @@ is_player_right_border:
 		mov r0, #0
 
 	.rest:
-		mov pc, lr
+		bx lr
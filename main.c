@@ -7,8 +7,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#include "music.h"
+#include "music_adpcm.h"
 #include "player.h"
+#include "fixed.h"
+#include "fastdiv.h"
+#include "sections.h"
+#include "adpcm.h"
+#include "song.h"
+#include "replay.h"
+#include "rng.h"
+#include "platform.h"
 
 /* include the background image we are using */
 #include "DefenderBackground.h"
@@ -17,6 +25,12 @@
 #include "space.h"
 #include "Landscape2.h"
 
+/* a recording to play back from ROM instead of reading the buttons, made by
+ * tools/replay2h.c and built in with -DREPLAY_HEADER='"run.h"' */
+#ifdef REPLAY_HEADER
+#include REPLAY_HEADER
+#endif
+
 #define SCREEN_WIDTH 240
 #define SCREEN_HEIGHT 160
 
@@ -34,10 +48,10 @@
 
 
 /* the control registers for the four tile layers */
-volatile unsigned short* bg0_control = (volatile unsigned short*) 0x4000008;
-volatile unsigned short* bg1_control = (volatile unsigned short*) 0x400000a;
-volatile unsigned short* bg2_control = (volatile unsigned short*) 0x400000c;
-volatile unsigned short* bg3_control = (volatile unsigned short*) 0x400000e;
+volatile unsigned short* bg0_control = (volatile unsigned short*) GBA_MEMORY(0x4000008);
+volatile unsigned short* bg1_control = (volatile unsigned short*) GBA_MEMORY(0x400000a);
+volatile unsigned short* bg2_control = (volatile unsigned short*) GBA_MEMORY(0x400000c);
+volatile unsigned short* bg3_control = (volatile unsigned short*) GBA_MEMORY(0x400000e);
 /* palette is always 256 colors */
 #define PALETTE_SIZE 256
 
@@ -45,30 +59,30 @@ volatile unsigned short* bg3_control = (volatile unsigned short*) 0x400000e;
 #define NUM_SPRITES 128
 
 /* the display control pointer points to the gba graphics register */
-volatile unsigned long* display_control = (volatile unsigned long*) 0x4000000;
+volatile unsigned int* display_control = (volatile unsigned int*) GBA_MEMORY(0x4000000);
 
 /* the memory location which controls sprite attributes */
-volatile unsigned short* sprite_attribute_memory = (volatile unsigned short*) 0x7000000;
+volatile unsigned short* sprite_attribute_memory = (volatile unsigned short*) GBA_MEMORY(0x7000000);
 
 /* the memory location which stores sprite image data */
-volatile unsigned short* sprite_image_memory = (volatile unsigned short*) 0x6010000;
+volatile unsigned short* sprite_image_memory = (volatile unsigned short*) GBA_MEMORY(0x6010000);
 
 /* the address of the color palettes used for backgrounds and sprites */
-volatile unsigned short* bg_palette = (volatile unsigned short*) 0x5000000;
-volatile unsigned short* sprite_palette = (volatile unsigned short*) 0x5000200;
+volatile unsigned short* bg_palette = (volatile unsigned short*) GBA_MEMORY(0x5000000);
+volatile unsigned short* sprite_palette = (volatile unsigned short*) GBA_MEMORY(0x5000200);
 
 /* the button register holds the bits which indicate whether each button has
  * been pressed - this has got to be volatile as well
  */
-volatile unsigned short* buttons = (volatile unsigned short*) 0x04000130;
+volatile unsigned short* buttons = (volatile unsigned short*) GBA_MEMORY(0x04000130);
 
 /* scrolling registers for backgrounds */
-volatile short* bg0_x_scroll = (unsigned short*) 0x4000010;
-volatile short* bg0_y_scroll = (unsigned short*) 0x4000012;
-volatile short* bg1_y_scroll = (unsigned short*) 0x4000016;
-volatile short* bg1_x_scroll = (unsigned short*) 0x4000014;
-volatile short* bg2_x_scroll = (unsigned short*) 0x4000018;
-volatile short* bg2_y_scroll = (unsigned short*) 0x400001a;
+volatile short* bg0_x_scroll = (unsigned short*) GBA_MEMORY(0x4000010);
+volatile short* bg0_y_scroll = (unsigned short*) GBA_MEMORY(0x4000012);
+volatile short* bg1_y_scroll = (unsigned short*) GBA_MEMORY(0x4000016);
+volatile short* bg1_x_scroll = (unsigned short*) GBA_MEMORY(0x4000014);
+volatile short* bg2_x_scroll = (unsigned short*) GBA_MEMORY(0x4000018);
+volatile short* bg2_y_scroll = (unsigned short*) GBA_MEMORY(0x400001a);
 /* the bit positions indicate each button - the first bit is for A, second for
  * B, and so on, each constant below can be ANDED into the register to get the
  * status of any one button */
@@ -84,35 +98,72 @@ volatile short* bg2_y_scroll = (unsigned short*) 0x400001a;
 #define BUTTON_L (1 << 9)
 
 // timer control registers
-volatile unsigned short* timer0_data = (volatile unsigned short*) 0x4000100;
-volatile unsigned short* timer0_control = (volatile unsigned short*) 0x4000102;
+volatile unsigned short* timer0_data = (volatile unsigned short*) GBA_MEMORY(0x4000100);
+volatile unsigned short* timer0_control = (volatile unsigned short*) GBA_MEMORY(0x4000102);
+volatile unsigned short* timer1_data = (volatile unsigned short*) GBA_MEMORY(0x4000104);
+volatile unsigned short* timer1_control = (volatile unsigned short*) GBA_MEMORY(0x4000106);
+volatile unsigned short* timer2_data = (volatile unsigned short*) GBA_MEMORY(0x4000108);
+volatile unsigned short* timer2_control = (volatile unsigned short*) GBA_MEMORY(0x400010A);
+volatile unsigned short* timer3_data = (volatile unsigned short*) GBA_MEMORY(0x400010C);
+volatile unsigned short* timer3_control = (volatile unsigned short*) GBA_MEMORY(0x400010E);
 
 // bit positions for control registers
 #define TIMER_FREQ_1 0x0
 #define TIMER_FREQ_64 0x2
 #define TIMER_FREQ_256 0x3
 #define TIMER_FREQ_1024 0x4
+#define TIMER_CASCADE 0x4
+#define TIMER_IRQ 0x40
 #define TIMER_ENABLE 0x80
 
 // fixed clock speed
 #define CLOCK 16777216
-#define CYCLES_PER_BLANK 280806
+
+// 228 lines (160 drawn + 68 of vblank) of 1232 cycles each
+#define CYCLES_PER_BLANK 280896
 
 
 /* the scanline counter is a memory cell which is updated to indicate how
  * much of the screen has been drawn */
-volatile unsigned short* scanline_counter = (volatile unsigned short*) 0x4000006;
+volatile unsigned short* scanline_counter = (volatile unsigned short*) GBA_MEMORY(0x4000006);
+
+/* the game logic runs once every this many vblanks, a fixed 60 Hz step */
+#define VBLANKS_PER_STEP 1
+
+/* counts up once per vblank, from the interrupt handler */
+volatile unsigned int vblank_ticks = 0;
+
+/* the vblank tick the next game step is due at */
+unsigned int next_step_tick = 0;
+
+/* bios function which halts the cpu until the next vblank interrupt */
+void vblank_intr_wait();
+
+/* sleep until it is time for the next game step, which always starts right
+ * at the beginning of a vblank so it's safe to scroll and move sprites */
+void wait_step() {
+    next_step_tick += VBLANKS_PER_STEP;
 
-/* wait for the screen to be fully drawn so we can do something during vblank */
-void wait_vblank() {
-    /* wait until all 160 lines have been updated */
-    while (*scanline_counter < 160) { }
+    /* if the last step ran long, start this one at the very next vblank
+     * rather than running several steps back to back to catch up */
+    if ((int) (vblank_ticks - next_step_tick) >= 0) {
+        next_step_tick = vblank_ticks + 1;
+    }
+
+    while ((int) (vblank_ticks - next_step_tick) < 0) {
+        vblank_intr_wait();
+    }
 }
 
+/* the button register as it was read at the start of this game step (or
+ * played back from a recording), so every check in a step sees the same
+ * buttons - see replay_step */
+unsigned short buttons_held = 0x3ff;
+
 /* this function checks whether a particular button has been pressed */
 unsigned char button_pressed(unsigned short button) {
     /* and the button register with the button constant we want */
-    unsigned short pressed = *buttons & button;
+    unsigned short pressed = buttons_held & button;
 
     /* if this value is zero, then it's not pressed */
     if (pressed == 0) {
@@ -125,13 +176,13 @@ unsigned char button_pressed(unsigned short button) {
 /* return a pointer to one of the 4 character blocks (0-3) */
 volatile unsigned short* char_block(unsigned long block) {
     /* they are each 16K big */
-    return (volatile unsigned short*) (0x6000000 + (block * 0x4000));
+    return (volatile unsigned short*) GBA_MEMORY(0x6000000 + (block * 0x4000));
 }
 
 /* return a pointer to one of the 32 screen blocks (0-31) */
 volatile unsigned short* screen_block(unsigned long block) {
     /* they are each 2K big */
-    return (volatile unsigned short*) (0x6000000 + (block * 0x800));
+    return (volatile unsigned short*) GBA_MEMORY(0x6000000 + (block * 0x800));
 }
 
 /* flag for turning on DMA */
@@ -147,141 +198,904 @@ volatile unsigned short* screen_block(unsigned long block) {
 // repeat DMA interval
 #define DMA_REPEAT 0x2000000
 
-// sync the repetitions with timer 0
+// sync the repetitions with the sound FIFO's timer
 #define DMA_SYNC_TO_TIMER 0x30000000
 
+// start the destination over at each repetition
+#define DMA_DEST_RELOAD 0x600000
+
+// repeat in each hblank, after every line is drawn
+#define DMA_SYNC_TO_HBLANK 0x20000000
+
 /* pointer to the DMA source location */
-volatile unsigned int* dma_source = (volatile unsigned int*) 0x40000D4;
+volatile unsigned int* dma_source = (volatile unsigned int*) GBA_MEMORY(0x40000D4);
 
 /* pointer to the DMA destination location */
-volatile unsigned int* dma_destination = (volatile unsigned int*) 0x40000D8;
+volatile unsigned int* dma_destination = (volatile unsigned int*) GBA_MEMORY(0x40000D8);
 
 /* pointer to the DMA count/control */
-volatile unsigned int* dma_count = (volatile unsigned int*) 0x40000DC;
+volatile unsigned int* dma_count = (volatile unsigned int*) GBA_MEMORY(0x40000DC);
 
-// Control, source, and destination for DMA channels one and two
-volatile unsigned int* dma1_source = (volatile unsigned int*) 0x40000BC;
-volatile unsigned int* dma1_destination = (volatile unsigned int*) 0x40000C0;
-volatile unsigned int* dma1_control = (volatile unsigned int*) 0x40000C4;
+// Control, source, and destination for DMA channels zero, one and two
+volatile unsigned int* dma0_source = (volatile unsigned int*) GBA_MEMORY(0x40000B0);
+volatile unsigned int* dma0_destination = (volatile unsigned int*) GBA_MEMORY(0x40000B4);
+volatile unsigned int* dma0_control = (volatile unsigned int*) GBA_MEMORY(0x40000B8);
 
-volatile unsigned int* dma2_source = (volatile unsigned int*) 0x40000C8;
-volatile unsigned int* dma2_destination = (volatile unsigned int*) 0x40000CC;
-volatile unsigned int* dma2_control = (volatile unsigned int*) 0x40000D0;
+volatile unsigned int* dma1_source = (volatile unsigned int*) GBA_MEMORY(0x40000BC);
+volatile unsigned int* dma1_destination = (volatile unsigned int*) GBA_MEMORY(0x40000C0);
+volatile unsigned int* dma1_control = (volatile unsigned int*) GBA_MEMORY(0x40000C4);
 
-volatile unsigned short* interrupt_enable = (unsigned short*) 0x4000208;
-volatile unsigned short* interrupt_selection = (unsigned short*) 0x4000200;
-volatile unsigned short* interrupt_state = (unsigned short*) 0x4000202;
-volatile unsigned int* interrupt_callback = (unsigned int*) 0x3007FFC;
-volatile unsigned short* display_interrupts = (unsigned short*) 0x4000004;
+volatile unsigned int* dma2_source = (volatile unsigned int*) GBA_MEMORY(0x40000C8);
+volatile unsigned int* dma2_destination = (volatile unsigned int*) GBA_MEMORY(0x40000CC);
+volatile unsigned int* dma2_control = (volatile unsigned int*) GBA_MEMORY(0x40000D0);
+
+volatile unsigned short* interrupt_enable = (unsigned short*) GBA_MEMORY(0x4000208);
+volatile unsigned short* interrupt_selection = (unsigned short*) GBA_MEMORY(0x4000200);
+volatile unsigned short* interrupt_state = (unsigned short*) GBA_MEMORY(0x4000202);
+volatile unsigned int* interrupt_callback = (unsigned int*) GBA_MEMORY(0x3007FFC);
+volatile unsigned short* display_interrupts = (unsigned short*) GBA_MEMORY(0x4000004);
 
 #define INTERRUPT_VBLANK 0x1
 
-volatile unsigned short* master_sound = (volatile unsigned short*) 0x4000084;
+/* the interrupt sources, in priority order - each one's bit in
+ * interrupt_selection and interrupt_state is 1 << source */
+enum Interrupt {
+    IRQ_VBLANK,
+    IRQ_HBLANK,
+    IRQ_VCOUNT,
+    IRQ_TIMER0,
+    IRQ_TIMER1,
+    IRQ_TIMER2,
+    IRQ_TIMER3,
+    IRQ_SERIAL,
+    IRQ_DMA0,
+    IRQ_DMA1,
+    IRQ_DMA2,
+    IRQ_DMA3,
+    IRQ_KEYPAD,
+    IRQ_GAMEPAK,
+    IRQ_COUNT
+};
+
+/* the function to call for each interrupt source, called by interrupt_master
+ * in interrupt.s, which acknowledges the interrupt before calling it */
+typedef void (*interrupt_handler)();
+interrupt_handler interrupt_handlers[IRQ_COUNT];
+
+/* the sources which are allowed to interrupt a running handler */
+unsigned short interrupt_nest_mask = 0;
+
+/* the master handler, from interrupt.s */
+FAR_CALL void interrupt_master();
+
+/* install the master handler, with every source turned off */
+void interrupt_init() {
+    *interrupt_enable = 0;
+    *interrupt_selection = 0;
+    *interrupt_callback = GBA_ADDRESS(&interrupt_master);
+    *interrupt_enable = 1;
+}
+
+/* set the handler for an interrupt source, or turn it off with NULL
+ * the display interrupts are also switched on in display_interrupts, the
+ * timers, DMA channels and keypad need their own IRQ bits set by the caller */
+void interrupt_set(enum Interrupt source, interrupt_handler handler) {
+    unsigned short master = *interrupt_enable;
+    *interrupt_enable = 0;
+
+    interrupt_handlers[source] = handler;
+    if (handler) {
+        *interrupt_selection |= 1 << source;
+        if (source <= IRQ_VCOUNT) {
+            *display_interrupts |= 0x08 << source;
+        }
+    } else {
+        *interrupt_selection &= ~(1 << source);
+        if (source <= IRQ_VCOUNT) {
+            *display_interrupts &= ~(0x08 << source);
+        }
+    }
+
+    *interrupt_enable = master;
+}
+
+/* choose whether a source may interrupt the other handlers while they run,
+ * like HBlank, which has to be serviced before the line is drawn */
+void interrupt_nest(enum Interrupt source, int allowed) {
+    if (allowed) {
+        interrupt_nest_mask |= 1 << source;
+    } else {
+        interrupt_nest_mask &= ~(1 << source);
+    }
+}
+
+volatile unsigned short* master_sound = (volatile unsigned short*) GBA_MEMORY(0x4000084);
 #define SOUND_MASTER_ENABLE 0x80
 
-volatile unsigned short* sound_control = (volatile unsigned short*) 0x4000082;
+volatile unsigned short* sound_control = (volatile unsigned short*) GBA_MEMORY(0x4000082);
 
 // defines for sound control registers
 #define SOUND_A_RIGHT_CHANNEL   0x100
 #define SOUND_A_LEFT_CHANNEL    0x200
+#define SOUND_A_TIMER1          0x400
 #define SOUND_A_FIFO_RESET      0x800
 #define SOUND_B_RIGHT_CHANNEL   0x1000
 #define SOUND_B_LEFT_CHANNEL    0x2000
+#define SOUND_B_TIMER1          0x4000
 #define SOUND_B_FIFO_RESET      0x8000
 
-volatile unsigned char* fifo_buffer_a = (volatile unsigned char*) 0x40000A0;
-volatile unsigned char* fifo_buffer_b = (volatile unsigned char*) 0x40000A4;
+volatile unsigned char* fifo_buffer_a = (volatile unsigned char*) GBA_MEMORY(0x40000A0);
+volatile unsigned char* fifo_buffer_b = (volatile unsigned char*) GBA_MEMORY(0x40000A4);
 
-unsigned int channel_a_vblanks_remaining = 0;
 unsigned int channel_b_vblanks_remaining = 0;
 
-// plays a sound using the number of samples, sample rate, and channel 'A' or 'B'
-void play_sound(const signed char* sound, int total_samples, int sample_rate, char channel) {
-    /* start by disabling the timer and dma controller (to reset a previous sound) */
-    *timer0_control = 0;
-    if (channel == 'A') {
-        *dma1_control = 0;
-    } else if (channel == 'B') {
-        *dma2_control = 0;
-    }
+/* the timer ticks between samples for a sample rate (samples/second)
+ * we divide the clock (ticks/second) by the sample rate, this is meant for
+ * constant rates so the compiler does the divide instead of the GBA */
+#define TICKS_PER_SAMPLE(sample_rate) (CLOCK / (sample_rate))
+
+/* the rate the music was recorded at */
+#define MUSIC_SAMPLE_RATE 16000
+
+/* each channel has its own sample timer, so starting a sound on one doesn't
+ * disturb the other - channel A plays the mixer's output, fed by DMA 1 at the
+ * rate of timer 0, and channel B plays single sounds straight from ROM, fed
+ * by DMA 2 at the rate of timer 1 */
+
+/* the mixer runs at 18157 Hz, 924 ticks per sample, because that makes
+ * exactly 304 samples each frame (280896 cycles), so one frame of samples can
+ * be mixed each vblank and the buffers swap in step with the screen - 304 is
+ * also a multiple of the 16 bytes DMA hands the FIFO at a time */
+#define MIXER_TICKS_PER_SAMPLE 924
+#define MIXER_RATE (CLOCK / MIXER_TICKS_PER_SAMPLE)
+#define MIXER_SAMPLES (CYCLES_PER_BLANK / MIXER_TICKS_PER_SAMPLE)
+
+/* how many sounds can play at once */
+#define MIXER_VOICES 8
+
+/* voice positions and steps are fixed point with this many fractional bits,
+ * enough for 1M samples in a sound */
+#define MIXER_FRACTION 12
+
+/* the step through a sound recorded at sample_rate that plays it back at its
+ * own pitch, meant for constant rates like TICKS_PER_SAMPLE */
+#define MIXER_STEP(sample_rate) \
+    ((((sample_rate) << MIXER_FRACTION) + MIXER_RATE / 2) / MIXER_RATE)
+
+/* the loudest a voice can be */
+#define MIXER_MAX_VOLUME 64
+
+struct Voice {
+    const signed char* data;
+    unsigned int position;  /* fixed point, see MIXER_FRACTION */
+    unsigned int step;      /* how far position moves each sample */
+    unsigned int end;       /* position at the end of the sound */
+    unsigned int loop;      /* length of the part that loops, 0 for none */
+    int volume;             /* 0 to MIXER_MAX_VOLUME */
+    int active;
+    int reserved;           /* kept for the song player, mixer_play skips it */
+};
+
+struct Voice voices[MIXER_VOICES];
 
-    /* output to both sides and reset the FIFO */
-    if (channel == 'A') {
-        *sound_control |= SOUND_A_RIGHT_CHANNEL | SOUND_A_LEFT_CHANNEL | SOUND_A_FIFO_RESET;
-    } else if (channel == 'B') {
-        *sound_control |= SOUND_B_RIGHT_CHANNEL | SOUND_B_LEFT_CHANNEL | SOUND_B_FIFO_RESET;
+/* the FIFO asks for 16 more bytes whenever it is down to 16, so by the end
+ * of a frame DMA has already read this far past the samples played */
+#define MIXER_READ_AHEAD 16
+
+/* two frames of samples side by side, DMA plays one while the other is mixed
+ * they are next to each other so DMA runs straight on from the first into
+ * the second, and only has to be pointed back at the start every other frame
+ * the bytes DMA reads past the end are a copy of the start of the first half,
+ * so DMA is pointed back just after them */
+signed char mix_buffer[2 * MIXER_SAMPLES + MIXER_READ_AHEAD] __attribute__((aligned(4)));
+
+/* the voices are added up here before being scaled back down to 8 bits */
+int mix_total[MIXER_SAMPLES];
+
+/* which half of mix_buffer DMA is playing from this frame */
+int mix_playing = 0;
+
+/* the vblank handler leaves the mixer alone until it has been set up, then
+ * starts the timer and DMA at the next vblank so they're in step with it */
+int mixer_running = 0;
+
+/* set up the mixer on channel A with all voices silent, it starts playing at
+ * the next vblank */
+void mixer_init() {
+    for (int i = 0; i < MIXER_VOICES; i++) {
+        voices[i].active = 0;
+        voices[i].reserved = 0;
+    }
+    for (int i = 0; i < 2 * MIXER_SAMPLES + MIXER_READ_AHEAD; i++) {
+        mix_buffer[i] = 0;
     }
+    mix_playing = 1;
 
     /* enable all sound */
     *master_sound = SOUND_MASTER_ENABLE;
 
-    /* set the dma channel to transfer from the sound array to the sound buffer */
-    if (channel == 'A') {
-        *dma1_source = (unsigned int) sound;
-        *dma1_destination = (unsigned int) fifo_buffer_a;
+    /* start by disabling the timer and dma controller */
+    *timer0_control = 0;
+    *dma1_control = 0;
+
+    /* output to both sides from timer 0 and reset the FIFO */
+    *sound_control = (*sound_control & ~SOUND_A_TIMER1) |
+        SOUND_A_RIGHT_CHANNEL | SOUND_A_LEFT_CHANNEL | SOUND_A_FIFO_RESET;
+
+    /* the dma channel transfers from the mix buffer to the sound buffer */
+    *dma1_destination = GBA_ADDRESS(fifo_buffer_a);
+    *timer0_data = 65536 - MIXER_TICKS_PER_SAMPLE;
+
+    mixer_running = 1;
+}
+
+/* start a sound of length samples on a free voice, stepping through it by
+ * step each sample (see MIXER_STEP) - if loop_start is 0 or more the sound
+ * goes back there each time it reaches the end and plays until stopped
+ * returns the voice, or -1 if they are all busy */
+int mixer_play(const signed char* data, int length, unsigned int step, int loop_start, int volume) {
+    for (int i = 0; i < MIXER_VOICES; i++) {
+        if (!voices[i].active && !voices[i].reserved) {
+            voices[i].data = data;
+            voices[i].position = 0;
+            voices[i].step = step;
+            voices[i].end = length << MIXER_FRACTION;
+            voices[i].loop = loop_start < 0 ? 0 : (length - loop_start) << MIXER_FRACTION;
+            voices[i].volume = volume;
+
+            /* the vblank interrupt mixes the voice once this is set */
+            voices[i].active = 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* silence a voice */
+void mixer_stop(int voice) {
+    voices[voice].active = 0;
+}
+
+/* add one voice's samples into mix_total
+ * this is the inner loop of the mixer, about 10 cycles a sample in ARM code
+ * from IWRAM, so a frame costs roughly 3000 cycles per voice playing plus
+ * 2000 to scale the total down - 1% of a frame for each voice */
+IWRAM_CODE void mixer_add_voice(struct Voice* voice) {
+    const signed char* data = voice->data;
+    unsigned int position = voice->position;
+    unsigned int step = voice->step;
+    unsigned int end = voice->end;
+    int volume = voice->volume;
+
+    for (int i = 0; i < MIXER_SAMPLES; i++) {
+        mix_total[i] += data[position >> MIXER_FRACTION] * volume;
+        position += step;
+
+        if (position >= end) {
+            if (voice->loop == 0) {
+                voice->active = 0;
+                return;
+            }
+            position -= voice->loop;
+        }
+    }
+
+    voice->position = position;
+}
+
+/* the music is stored as ADPCM, at 4 bits a sample, and decoded a frame at a
+ * time into a ring of samples, which a mixer voice loops around forever */
+#define STREAM_RING 1024
+
+signed char stream_ring[STREAM_RING];
+
+struct Stream {
+    const unsigned char* data;  /* two samples to a byte, low nibble first */
+    int samples;
+    int next;                   /* the next sample of data to decode */
+    struct AdpcmState state;
+    int write;                  /* where in stream_ring it goes */
+    int voice;                  /* the voice playing stream_ring, or -1 */
+};
+
+struct Stream stream = {0, 0, 0, {0, 0}, 0, -1};
+
+/* decode samples into the ring until it's full right up to where the voice
+ * is reading from - after the first time, that is the one frame's worth of
+ * samples the voice used last frame, about 270 at 16000 Hz */
+IWRAM_CODE void stream_fill() {
+    if (stream.voice < 0) {
+        return;
+    }
+
+    int read = voices[stream.voice].position >> MIXER_FRACTION;
+    int free = (read - stream.write - 1) & (STREAM_RING - 1);
+
+    for (int i = 0; i < free; i++) {
+        int byte = stream.data[stream.next >> 1];
+        int nibble = (stream.next & 1) ? byte >> 4 : byte & 0xf;
+        stream_ring[stream.write] = adpcm_decode(&stream.state, nibble) >> 8;
+        stream.write = (stream.write + 1) & (STREAM_RING - 1);
+
+        /* loop back to the start, where the decoder started out at zero */
+        if (++stream.next == stream.samples) {
+            stream.next = 0;
+            stream.state.sample = 0;
+            stream.state.step = 0;
+        }
+    }
+}
+
+/* start streaming an ADPCM sound, looping forever, stepping through it by step
+ * each sample (see MIXER_STEP) */
+void stream_play(const unsigned char* data, int samples, unsigned int step, int volume) {
+    /* keep the vblank interrupt from filling the ring while it's set up */
+    unsigned short master = *interrupt_enable;
+    *interrupt_enable = 0;
+
+    if (stream.voice >= 0) {
+        mixer_stop(stream.voice);
+    }
+    stream.data = data;
+    stream.samples = samples;
+    stream.next = 0;
+    stream.state.sample = 0;
+    stream.state.step = 0;
+    stream.write = 0;
+
+    /* fill the ring before the voice gets mixed */
+    stream.voice = mixer_play(stream_ring, STREAM_RING, step, 0, volume);
+    stream_fill();
+
+    *interrupt_enable = master;
+}
+
+/* the song player steps through a song's patterns a row at a time, starting
+ * instruments on its own 4 voices, and the mixer plays them like any sound
+ * the game doesn't play a song yet, so only song_vblank's check for one is
+ * in IWRAM, the rest stays in ROM until something does */
+
+/* the step which plays an instrument at each note, 1 (C-1) to 36 (B-3)
+ * instruments are recorded so that C-1 is 4143 Hz, the Amiga's rate for it */
+const unsigned short song_note_steps[36] = {
+    935, 990, 1050, 1111, 1180, 1250, 1325, 1404, 1487, 1575, 1667, 1766,
+    1869, 1981, 2100, 2223, 2360, 2500, 2649, 2807, 2974, 3150, 3334, 3540,
+    3739, 3961, 4211, 4445, 4707, 5001, 5299, 5595, 5927, 6300, 6668, 7081
+};
+
+/* songs tick at tempo * 2 / 5 times a second, which is this many 16.16 fixed
+ * point ticks per vblank for each beat of tempo */
+#define SONG_TICK_RATE 439
+
+struct SongChannel {
+    int voice;
+    const struct SongInstrument* instrument;
+    int volume;     /* 0 to 64 */
+};
+
+struct SongPlayer {
+    const struct Song* song;
+    int order;          /* which position in the song's orders */
+    int row;
+    int tick;           /* counts up to speed, the row is played at 0 */
+    int speed;
+    int tempo;
+    int tick_fraction;  /* 16.16 fixed point ticks built up so far */
+    int jump_order;     /* where effects B and D send it after this row, or -1 */
+    int jump_row;
+    int volume;         /* of the whole song, 0 to MIXER_MAX_VOLUME */
+    struct SongChannel channels[SONG_CHANNELS];
+};
+
+struct SongPlayer song_player = {0};
+
+/* set the volume of the voice a channel plays through */
+void song_channel_volume(struct SongChannel* channel) {
+    voices[channel->voice].volume = (channel->volume * song_player.volume) >> 6;
+}
+
+/* start a channel's instrument at a note */
+void song_channel_note(struct SongChannel* channel, int note) {
+    const struct SongInstrument* instrument = channel->instrument;
+    struct Voice* voice = &voices[channel->voice];
+
+    voice->active = 0;
+    if (!instrument || instrument->length == 0) {
+        return;
+    }
+
+    voice->data = song_player.song->data + instrument->offset;
+    voice->position = 0;
+    voice->step = song_note_steps[note - 1];
+    voice->end = instrument->length << MIXER_FRACTION;
+    voice->loop = instrument->loop_length << MIXER_FRACTION;
+    song_channel_volume(channel);
+    voice->active = 1;
+}
+
+/* play the notes and effects of the current row */
+void song_row() {
+    const struct Song* song = song_player.song;
+    const unsigned char* cell = song->patterns
+        + song->orders[song_player.order] * SONG_PATTERN_BYTES
+        + song_player.row * SONG_CHANNELS * SONG_CELL_BYTES;
+
+    for (int i = 0; i < SONG_CHANNELS; i++, cell += SONG_CELL_BYTES) {
+        struct SongChannel* channel = &song_player.channels[i];
+        int note = cell[0], instrument = cell[1], effect = cell[2], parameter = cell[3];
+
+        /* a new instrument also resets the channel to its volume */
+        if (instrument) {
+            channel->instrument = &song->instruments[instrument - 1];
+            channel->volume = channel->instrument->volume;
+            song_channel_volume(channel);
+        }
+        if (note) {
+            song_channel_note(channel, note);
+        }
+
+        switch (effect) {
+            case SONG_EFFECT_VOLUME:
+                channel->volume = parameter > 64 ? 64 : parameter;
+                song_channel_volume(channel);
+                break;
+
+            case SONG_EFFECT_SPEED:
+                /* below 32 is ticks per row, the rest is the tempo */
+                if (parameter >= 32) {
+                    song_player.tempo = parameter;
+                } else if (parameter > 0) {
+                    song_player.speed = parameter;
+                }
+                break;
+
+            case SONG_EFFECT_JUMP:
+                song_player.jump_order = parameter;
+                song_player.jump_row = 0;
+                break;
+
+            case SONG_EFFECT_BREAK:
+                /* the row is written in decimal, one digit a nibble */
+                if (song_player.jump_order < 0) {
+                    song_player.jump_order = song_player.order + 1;
+                }
+                song_player.jump_row = (parameter >> 4) * 10 + (parameter & 0xf);
+                if (song_player.jump_row >= SONG_ROWS) {
+                    song_player.jump_row = 0;
+                }
+                break;
+        }
+    }
+}
+
+/* one tick of the song, which plays a row every speed ticks */
+FAR_CALL void song_tick() {
+    if (song_player.tick == 0) {
+        song_row();
+    }
+
+    if (++song_player.tick < song_player.speed) {
+        return;
+    }
+    song_player.tick = 0;
+
+    /* on to the next row, or wherever an effect said */
+    if (song_player.jump_order >= 0) {
+        song_player.order = song_player.jump_order;
+        song_player.row = song_player.jump_row;
+        song_player.jump_order = -1;
+    } else if (++song_player.row == SONG_ROWS) {
+        song_player.row = 0;
+        song_player.order++;
+    }
+
+    /* the song loops from the start */
+    if (song_player.order >= song_player.song->order_count) {
+        song_player.order = 0;
+    }
+}
+
+/* called each vblank before mixing, to play the ticks that have come due */
+IWRAM_CODE void song_vblank() {
+    if (!song_player.song) {
+        return;
+    }
+
+    song_player.tick_fraction += song_player.tempo * SONG_TICK_RATE;
+    while (song_player.tick_fraction >= 0x10000) {
+        song_player.tick_fraction -= 0x10000;
+        song_tick();
+    }
+}
+
+/* stop the song and give its voices back to the mixer */
+void song_stop() {
+    unsigned short master = *interrupt_enable;
+    *interrupt_enable = 0;
+
+    if (song_player.song) {
+        for (int i = 0; i < SONG_CHANNELS; i++) {
+            voices[song_player.channels[i].voice].active = 0;
+            voices[song_player.channels[i].voice].reserved = 0;
+        }
+        song_player.song = NULL;
+    }
+
+    *interrupt_enable = master;
+}
+
+/* start playing a song from tools/mod2gba.c from the beginning, looping
+ * forever - it takes SONG_CHANNELS voices, which must be free, and returns
+ * 0 if they aren't */
+int song_play(const struct Song* song, int volume) {
+    song_stop();
+
+    unsigned short master = *interrupt_enable;
+    *interrupt_enable = 0;
+
+    int channel = 0;
+    for (int i = 0; i < MIXER_VOICES && channel < SONG_CHANNELS; i++) {
+        if (!voices[i].active && !voices[i].reserved) {
+            song_player.channels[channel].voice = i;
+            song_player.channels[channel].instrument = NULL;
+            song_player.channels[channel].volume = 0;
+            channel++;
+        }
+    }
+
+    if (channel == SONG_CHANNELS) {
+        for (int i = 0; i < SONG_CHANNELS; i++) {
+            voices[song_player.channels[i].voice].reserved = 1;
+        }
+        song_player.order = 0;
+        song_player.row = 0;
+        song_player.tick = 0;
+        song_player.speed = song->speed;
+        song_player.tempo = song->tempo;
+        song_player.tick_fraction = 0;
+        song_player.jump_order = -1;
+        song_player.volume = volume;
+
+        /* the vblank interrupt starts playing it once this is set */
+        song_player.song = song;
+    }
+
+    *interrupt_enable = master;
+    return channel == SONG_CHANNELS;
+}
+
+/* change how fast the song plays, 125 is normal, so the music can speed up
+ * with the game - it only costs a multiply each vblank */
+void song_set_tempo(int tempo) {
+    song_player.tempo = tempo;
+}
+
+/* mix one frame of samples into the half of mix_buffer which isn't playing */
+IWRAM_CODE void mixer_mix() {
+    for (int i = 0; i < MIXER_SAMPLES; i++) {
+        mix_total[i] = 0;
+    }
+
+    for (int i = 0; i < MIXER_VOICES; i++) {
+        if (voices[i].active) {
+            mixer_add_voice(&voices[i]);
+        }
+    }
+
+    /* scale back to 8 bits, anything too loud is clipped */
+    signed char* out = mix_buffer + (1 - mix_playing) * MIXER_SAMPLES;
+    for (int i = 0; i < MIXER_SAMPLES; i++) {
+        int sample = mix_total[i] >> 6;
+        if (sample > 127) {
+            sample = 127;
+        } else if (sample < -128) {
+            sample = -128;
+        }
+        out[i] = sample;
+    }
+
+    /* DMA reads the start of the first half from past the end of the second */
+    if (out == mix_buffer) {
+        for (int i = 0; i < MIXER_READ_AHEAD; i++) {
+            mix_buffer[2 * MIXER_SAMPLES + i] = mix_buffer[i];
+        }
+    }
+}
+
+/* swap the mix buffers, called right at the start of each vblank, when DMA
+ * has just finished handing one frame of samples to the FIFO */
+IWRAM_CODE void mixer_vblank() {
+    if (!mixer_running) {
+        return;
+    }
+
+    mix_playing = 1 - mix_playing;
+
+    /* having played the second half, DMA has to go back to the first
+     * the FIFO is left alone, it holds the last sample of the frame and the
+     * copy of the first MIXER_READ_AHEAD bytes, so DMA carries on after them
+     * the very first time the FIFO is empty, and the sample timer starts */
+    if (mix_playing == 0) {
+        int starting = !(*timer0_control & TIMER_ENABLE);
+        *dma1_control = 0;
+        *dma1_source = GBA_ADDRESS(mix_buffer + (starting ? 0 : MIXER_READ_AHEAD));
         *dma1_control = DMA_DEST_FIXED | DMA_REPEAT | DMA_32 | DMA_SYNC_TO_TIMER | DMA_ENABLE;
-    } else if (channel == 'B') {
-        *dma2_source = (unsigned int) sound;
-        *dma2_destination = (unsigned int) fifo_buffer_b;
-        *dma2_control = DMA_DEST_FIXED | DMA_REPEAT | DMA_32 | DMA_SYNC_TO_TIMER | DMA_ENABLE;
+        platform_dma_written(1);
+
+        if (starting) {
+            *timer0_control = TIMER_ENABLE | TIMER_FREQ_1;
+        }
     }
 
-    /* set the timer so that it increments once each time a sample is due
-     * we divide the clock (ticks/second) by the sample rate (samples/second)
-     * to get the number of ticks/samples */
-    unsigned short ticks_per_sample = CLOCK / sample_rate;
+    song_vblank();
+    stream_fill();
+    mixer_mix();
+}
 
-    /* the timers all count up to 65536 and overflow at that point, so we count up to that
-     * now the timer will trigger each time we need a sample, and cause DMA to give it one! */
-    *timer0_data = 65536 - ticks_per_sample;
+// plays a sound once on channel B using the number of samples and timer ticks
+// per sample (see TICKS_PER_SAMPLE)
+void play_sound(const signed char* sound, int total_samples, unsigned short ticks_per_sample) {
+    /* enable all sound */
+    *master_sound = SOUND_MASTER_ENABLE;
+
+    /* start by disabling the timer and dma controller (to reset a previous sound) */
+    *timer1_control = 0;
+    *dma2_control = 0;
+
+    /* output to both sides from timer 1 and reset the FIFO */
+    *sound_control |= SOUND_B_TIMER1 | SOUND_B_RIGHT_CHANNEL | SOUND_B_LEFT_CHANNEL | SOUND_B_FIFO_RESET;
+
+    /* set the dma channel to transfer from the sound array to the sound buffer */
+    *dma2_source = GBA_ADDRESS(sound);
+    *dma2_destination = GBA_ADDRESS(fifo_buffer_b);
+    *dma2_control = DMA_DEST_FIXED | DMA_REPEAT | DMA_32 | DMA_SYNC_TO_TIMER | DMA_ENABLE;
+    platform_dma_written(2);
 
     /* determine length of playback in vblanks
      * this is the total number of samples, times the number of clock ticks per sample,
      * divided by the number of machine cycles per vblank (a constant) */
-    if (channel == 'A') {
-        channel_a_vblanks_remaining = total_samples * ticks_per_sample * (1.0 / CYCLES_PER_BLANK);
-    } else if (channel == 'B') {
-        channel_b_vblanks_remaining = total_samples * ticks_per_sample * (1.0 / CYCLES_PER_BLANK);
-    }
+    channel_b_vblanks_remaining = fixed_mul_high(total_samples * ticks_per_sample,
+            FIXED_RECIPROCAL(CYCLES_PER_BLANK));
 
-    /* enable the timer */
-    *timer0_control = TIMER_ENABLE | TIMER_FREQ_1;
+    /* the timers all count up to 65536 and overflow at that point, so we count up to that
+     * now the timer will trigger each time we need a sample, and cause DMA to give it one! */
+    *timer1_data = 65536 - ticks_per_sample;
+    *timer1_control = TIMER_ENABLE | TIMER_FREQ_1;
+}
+
+/* the scroll registers of bg0 and bg1, x then y, for a line of the screen
+ *
+ * HBlank DMA copies the next line's 2 words into the registers after each
+ * line is drawn, which on the GBA is about 8 cycles a line (IWRAM to IO,
+ * a cycle to read and one to write each word, plus the DMA's startup) - a
+ * bit over 1,200 cycles of the frame's 280,896, the CPU's only part in it
+ * being parallax_vblank once a frame
+ *
+ * the table is double buffered, which costs another 1.3K of IWRAM and no
+ * time: the game fills one in while DMA reads the other, so a step which
+ * runs on into the frame can't leave the screen half with the old scroll
+ * and half with the new */
+struct ParallaxLine {
+    short scroll[2][2];
+};
+
+#define PARALLAX_LINE_CYCLES 8
+
+/* one past the screen, as there's a hblank after the last line too */
+struct ParallaxLine parallax_tables[2][SCREEN_HEIGHT + 1] __attribute__((aligned(4)));
+
+/* the table DMA is reading, and the one last finished, which it reads next */
+volatile int parallax_showing = 0;
+volatile int parallax_ready = 0;
+
+/* start the last finished scroll table over for the frame about to be
+ * drawn: the first line's scroll is set now, and DMA 0 sets each of the
+ * others in the hblank before it - this is done every vblank, even those
+ * the game skips, so DMA never runs on past the end of the table */
+IWRAM_CODE void parallax_vblank() {
+    struct ParallaxLine* table = parallax_tables[parallax_ready];
+    parallax_showing = parallax_ready;
+
+    *dma0_control = 0;
+    *bg0_x_scroll = table[0].scroll[0][0];
+    *bg1_x_scroll = table[0].scroll[1][0];
+
+    *dma0_source = GBA_ADDRESS(&table[1]);
+    *dma0_destination = GBA_ADDRESS(bg0_x_scroll);
+    *dma0_control = 2 | DMA_DEST_RELOAD | DMA_REPEAT | DMA_32 | DMA_SYNC_TO_HBLANK | DMA_ENABLE;
+    platform_dma_written(0);
 }
 
 // called each vblank to time the sounds right
-void on_vblank() {
-    //disable interrupts temporarily
-    *interrupt_enable = 0;
-    unsigned short temp = *interrupt_state;
-
-    // look for vertical refresh
-    if ((*interrupt_state & INTERRUPT_VBLANK) == INTERRUPT_VBLANK) {
-        // update channel A
-        if (channel_a_vblanks_remaining == 0) {
-            // restart the sound
-            play_sound(music, music_bytes, 16000, 'A');
-        } else {
-            channel_a_vblanks_remaining--;
+IWRAM_CODE void on_vblank() {
+    vblank_ticks++;
+    parallax_vblank();
+
+    // channel A is the mixer, it needs the next frame of samples
+    mixer_vblank();
+
+    //update channel B
+    if (channel_b_vblanks_remaining == 0) {
+        //disable sound, DMA transfer and the timer on channel B
+        *sound_control &= ~(SOUND_B_RIGHT_CHANNEL | SOUND_B_LEFT_CHANNEL | SOUND_B_FIFO_RESET);
+        *dma2_control = 0;
+        *timer1_control = 0;
+    } else {
+        channel_b_vblanks_remaining--;
+    }
+}
+
+/* copy data using DMA, in IWRAM as the OAM flush uses it every frame */
+IWRAM_CODE void memcpy16_dma(unsigned short* dest, unsigned short* source, int amount) {
+    *dma_source = GBA_ADDRESS(source);
+    *dma_destination = GBA_ADDRESS(dest);
+    *dma_count = amount | DMA_16 | DMA_ENABLE;
+    platform_dma_written(3);
+}
+
+/* a screen block is 32 tiles across, and wraps around */
+#define SCREEN_BLOCK_WIDTH 32
+
+/* the most columns a map stream writes in one vblank, 64 bytes each - the
+ * scroll only ever moves a column at a time, anything more is caught up on
+ * over the next few frames */
+#define MAP_STREAM_BUDGET 2
+
+/* a tile map any number of tiles wide (at least 32), kept in ROM and shown
+ * through a screen block, so the world goes on for the whole map before it
+ * comes round again - or some of the map's rows, through those of the
+ * screen block, so they can scroll on their own
+ *
+ * the screen block holds the 32 columns from left onwards, each in the
+ * column of the screen block it would scroll into, so the background's x
+ * scroll is just the scroll - as that crosses a tile, the column that's gone
+ * off one side is overwritten with the one coming on the other */
+struct MapStream {
+    const unsigned short* map;
+    int width, height;
+    volatile unsigned short* screen;
+
+    /* the leftmost column held, in tiles from the start of the scroll, and
+     * which of the map's columns that is */
+    int left;
+    int left_map;
+};
+
+/* write one of the map's columns into a column of the screen block */
+IWRAM_CODE void map_stream_column(struct MapStream* stream, int column, int map_column) {
+    volatile unsigned short* dest = stream->screen + (column & (SCREEN_BLOCK_WIDTH - 1));
+    const unsigned short* source = stream->map + map_column;
+
+    /* a column is spread across the rows, so it can't be DMAed in one go */
+    for (int row = 0; row < stream->height; row++) {
+        dest[row * SCREEN_BLOCK_WIDTH] = source[row * stream->width];
+    }
+}
+
+/* start showing rows rows of a map from row onwards, in screen block block,
+ * at a scroll of scroll */
+void map_stream_init(struct MapStream* stream, const unsigned short* map, int width,
+        int row, int rows, int block, int scroll) {
+    stream->map = map + row * width;
+    stream->width = width;
+    stream->height = rows;
+    stream->screen = screen_block(block) + row * SCREEN_BLOCK_WIDTH;
+
+    stream->left = scroll >> 3;
+    stream->left_map = stream->left % width;
+    if (stream->left_map < 0) {
+        stream->left_map += width;
+    }
+
+    /* fill the whole screen block */
+    int map_column = stream->left_map;
+    for (int i = 0; i < SCREEN_BLOCK_WIDTH; i++) {
+        map_stream_column(stream, stream->left + i, map_column);
+        if (++map_column == width) {
+            map_column = 0;
         }
-        //update channel B
-        if (channel_b_vblanks_remaining == 0) {
-            //disable sound and DMA transfer on channel B
-            *sound_control &= ~(SOUND_B_RIGHT_CHANNEL | SOUND_B_LEFT_CHANNEL | SOUND_B_FIFO_RESET);
-            *dma2_control = 0;
+    }
+}
+
+/* bring the screen block up to the background's scroll, called during the
+ * vblank along with setting it */
+IWRAM_CODE void map_stream_scroll(struct MapStream* stream, int scroll) {
+    int left = scroll >> 3;
+
+    for (int budget = MAP_STREAM_BUDGET; budget > 0 && stream->left != left; budget--) {
+        if (stream->left < left) {
+            /* the column coming on at the right goes where the leftmost was */
+            int map_column = stream->left_map + SCREEN_BLOCK_WIDTH;
+            while (map_column >= stream->width) {
+                map_column -= stream->width;
+            }
+            map_stream_column(stream, stream->left + SCREEN_BLOCK_WIDTH, map_column);
+
+            stream->left++;
+            if (++stream->left_map == stream->width) {
+                stream->left_map = 0;
+            }
         } else {
-            channel_b_vblanks_remaining--;
+            /* and the one coming on at the left goes where the rightmost was */
+            stream->left--;
+            if (--stream->left_map < 0) {
+                stream->left_map = stream->width - 1;
+            }
+            map_stream_column(stream, stream->left, stream->left_map);
         }
     }
-    // restore/enable interrupts
-    *interrupt_state = temp;
-    *interrupt_enable = 1;
 }
 
-/* copy data using DMA */
-void memcpy16_dma(unsigned short* dest, unsigned short* source, int amount) {
-    *dma_source = (unsigned int) source;
-    *dma_destination = (unsigned int) dest;
-    *dma_count = amount | DMA_16 | DMA_ENABLE;
+/* a band of lines across a background which scrolls at its own speed, as a
+ * multiple of xscroll - it's whole rows of tiles, so each band can have its
+ * own part of the map streamed in */
+struct ParallaxBand {
+    int lines;
+    fixed8 speed;
+};
+
+/* the higher stars are further away, and the mountains further away than
+ * the ground the player flies over, which keeps up with xscroll */
+const struct ParallaxBand space_bands[] = {
+    {56, FIXED8(0.125)}, {56, FIXED8(0.25)}, {48, FIXED8(0.375)}
+};
+const struct ParallaxBand landscape_bands[] = {
+    {144, FIXED8(0.75)}, {16, FIXED8(1)}
+};
+
+#define PARALLAX_BANDS 4
+
+/* a background split into bands, each with a map stream of its rows */
+struct Parallax {
+    const struct ParallaxBand* bands;
+    int count;
+    struct MapStream streams[PARALLAX_BANDS];
+};
+
+struct Parallax space_parallax, landscape_parallax;
+
+/* split a map into bands, shown through screen block block - the bands'
+ * lines have to add up to the screen's height */
+void parallax_init(struct Parallax* layer, const struct ParallaxBand* bands, int count,
+        const unsigned short* map, int width, int height, int block) {
+    layer->bands = bands;
+    layer->count = count;
+
+    int row = 0;
+    for (int i = 0; i < count; i++) {
+        /* the last band takes the rest of the map too, below the screen */
+        int rows = i == count - 1 ? height - row : bands[i].lines / 8;
+        map_stream_init(&layer->streams[i], map, width, row, rows, block, 0);
+        row += rows;
+    }
+}
+
+/* scroll each of a background's bands, writing it into the band's lines of
+ * the scroll table and bringing its map stream up to it */
+IWRAM_CODE void parallax_fill(struct Parallax* layer, struct ParallaxLine* table, int bg, int xscroll) {
+    int line = 0;
+    for (int i = 0; i < layer->count; i++) {
+        int scroll = fixed8_to_int(xscroll * layer->bands[i].speed);
+        map_stream_scroll(&layer->streams[i], scroll);
+
+        for (int end = line + layer->bands[i].lines; line < end; line++) {
+            table[line].scroll[bg][0] = scroll;
+        }
+    }
+}
+
+/* fill in the scroll table DMA isn't reading for the next frame */
+void parallax_update(int xscroll) {
+    int back = !parallax_showing;
+    parallax_fill(&space_parallax, parallax_tables[back], 0, xscroll);
+    parallax_fill(&landscape_parallax, parallax_tables[back], 1, xscroll);
+    parallax_ready = back;
+
+    /* done during the vblank, as it normally is, so it can be shown from
+     * this frame rather than the next */
+    if (*scanline_counter >= SCREEN_HEIGHT) {
+        parallax_vblank();
+    }
 }
 
 /* function to setup background 0 for this program */
@@ -312,18 +1126,14 @@ void setup_background() {
         (1 << 13) |
         (0 << 14);
 
-    /* load the tile data into screen block 16 */
-    memcpy16_dma((unsigned short*) screen_block(16), (unsigned short*) space, space_width * space_height);
-
-    //Load landscape map into screen black 18
-    memcpy16_dma((unsigned short*) screen_block(18), (unsigned short*) Landscape2, Landscape2_width * Landscape2_height);
-
-}
-/* just kill time */
-void delay(unsigned int amount) {
-    for (int i = 0; i < amount * 10; i++);
+    /* stream the star map into screen block 16 and the landscape into 18,
+     * each in bands which scroll at their own speeds */
+    parallax_init(&space_parallax, space_bands, sizeof(space_bands) / sizeof(space_bands[0]),
+            space, space_width, space_height, 16);
+    parallax_init(&landscape_parallax, landscape_bands,
+            sizeof(landscape_bands) / sizeof(landscape_bands[0]),
+            Landscape2, Landscape2_width, Landscape2_height, 18);
 }
-
 /* a sprite is a moveable image on the screen */
 struct Sprite {
     unsigned short attribute0;
@@ -334,7 +1144,30 @@ struct Sprite {
 
 /* array of all the sprites available on the GBA */
 struct Sprite sprites[NUM_SPRITES];
-int next_sprite_index = 0;
+
+/* stack of the sprite indices which are not in use, and which are */
+unsigned char sprite_free_list[NUM_SPRITES];
+int sprite_free_count = 0;
+unsigned char sprite_used[NUM_SPRITES];
+
+/* the span of sprites [low, high) changed since the last copy into OAM */
+int sprite_dirty_low = NUM_SPRITES;
+int sprite_dirty_high = 0;
+
+/* how many bytes of OAM the last sprite_update_all copied */
+unsigned int sprite_bytes_copied = 0;
+
+/* record that a sprite needs to be copied into OAM at the next update */
+IWRAM_CODE void sprite_mark_dirty(struct Sprite* sprite) {
+    int index = sprite - sprites;
+
+    if (index < sprite_dirty_low) {
+        sprite_dirty_low = index;
+    }
+    if (index >= sprite_dirty_high) {
+        sprite_dirty_high = index + 1;
+    }
+}
 
 /* the different sizes of sprites which are possible */
 enum SpriteSize {
@@ -352,12 +1185,17 @@ enum SpriteSize {
     SIZE_32_64
 };
 
-/* function to initialize a sprite with its properties, and return a pointer */
+/* function to initialize a sprite with its properties, and return a pointer
+ * returns NULL when all of the sprites are already in use */
 struct Sprite* sprite_init(int x, int y, enum SpriteSize size,
         int horizontal_flip, int vertical_flip, int tile_index, int priority) {
 
-    /* grab the next index */
-    int index = next_sprite_index++;
+    /* grab the next free index */
+    if (sprite_free_count == 0) {
+        return NULL;
+    }
+    int index = sprite_free_list[--sprite_free_count];
+    sprite_used[index] = 1;
 
     /* setup the bits used for each shape/size possible */
     int size_bits, shape_bits;
@@ -399,41 +1237,82 @@ struct Sprite* sprite_init(int x, int y, enum SpriteSize size,
         (priority << 10) | // priority */
         (0 << 12);         // palette bank (only 16 color)*/
 
+    sprite_mark_dirty(&sprites[index]);
+
     /* return pointer to this sprite */
     return &sprites[index];
 }
 
 /* update all of the spries on the screen */
-void sprite_update_all() {
-    /* copy them all over */
-    memcpy16_dma((unsigned short*) sprite_attribute_memory, (unsigned short*) sprites, NUM_SPRITES * 4);
+IWRAM_CODE void sprite_update_all() {
+    /* nothing changed since last time, so OAM is already up to date */
+    if (sprite_dirty_low >= sprite_dirty_high) {
+        sprite_bytes_copied = 0;
+        return;
+    }
+
+    /* copy over only the span of sprites that were touched */
+    int count = sprite_dirty_high - sprite_dirty_low;
+    memcpy16_dma((unsigned short*) sprite_attribute_memory + sprite_dirty_low * 4,
+            (unsigned short*) &sprites[sprite_dirty_low], count * 4);
+    sprite_bytes_copied = count * sizeof(struct Sprite);
+
+    /* start tracking again from an empty span */
+    sprite_dirty_low = NUM_SPRITES;
+    sprite_dirty_high = 0;
 }
 
 /* setup all sprites */
 void sprite_clear() {
-    /* clear the index counter */
-    next_sprite_index = 0;
+    /* every index is free again, lowest ones are handed out first */
+    sprite_free_count = 0;
+    for (int i = NUM_SPRITES - 1; i >= 0; i--) {
+        sprite_free_list[sprite_free_count++] = i;
+        sprite_used[i] = 0;
+    }
 
     /* move all sprites offscreen to hide them */
     for(int i = 0; i < NUM_SPRITES; i++) {
         sprites[i].attribute0 = SCREEN_HEIGHT;
         sprites[i].attribute1 = SCREEN_WIDTH;
     }
+
+    /* every sprite must be hidden in OAM too */
+    sprite_dirty_low = 0;
+    sprite_dirty_high = NUM_SPRITES;
 }
 
-/* set a sprite postion */
-void sprite_position(struct Sprite* sprite, int x, int y) {
-    /* clear out the y coordinate */
-    sprite->attribute0 &= 0xff00;
+/* hide a sprite and give its index back so it can be reused - returns 0,
+ * and does nothing, if it wasn't in use, so it can't be handed out twice */
+int sprite_free(struct Sprite* sprite) {
+    int index = sprite - sprites;
+    if (index < 0 || index >= NUM_SPRITES || !sprite_used[index] ||
+            sprite_free_count == NUM_SPRITES) {
+        return 0;
+    }
+    sprite_used[index] = 0;
 
-    /* set the new y coordinate */
-    sprite->attribute0 |= (y & 0xff);
+    /* move it offscreen */
+    sprite->attribute0 = SCREEN_HEIGHT;
+    sprite->attribute1 = SCREEN_WIDTH;
+    sprite_mark_dirty(sprite);
 
-    /* clear out the x coordinate */
-    sprite->attribute1 &= 0xfe00;
+    sprite_free_list[sprite_free_count++] = index;
+    return 1;
+}
 
-    /* set the new x coordinate */
-    sprite->attribute1 |= (x & 0x1ff);
+/* set a sprite postion */
+IWRAM_CODE void sprite_position(struct Sprite* sprite, int x, int y) {
+    /* clear out the old coordinates and set the new ones */
+    unsigned short attribute0 = (sprite->attribute0 & 0xff00) | (y & 0xff);
+    unsigned short attribute1 = (sprite->attribute1 & 0xfe00) | (x & 0x1ff);
+
+    /* only sprites which actually moved need to go to OAM */
+    if (attribute0 != sprite->attribute0 || attribute1 != sprite->attribute1) {
+        sprite->attribute0 = attribute0;
+        sprite->attribute1 = attribute1;
+        sprite_mark_dirty(sprite);
+    }
 }
 
 /* move a sprite in a direction */
@@ -450,33 +1329,47 @@ void sprite_move(struct Sprite* sprite, int dx, int dy) {
 
 /* change the vertical flip flag */
 void sprite_set_vertical_flip(struct Sprite* sprite, int vertical_flip) {
+    unsigned short attribute1;
     if (vertical_flip) {
         /* set the bit */
-        sprite->attribute1 |= 0x2000;
+        attribute1 = sprite->attribute1 | 0x2000;
     } else {
         /* clear the bit */
-        sprite->attribute1 &= 0xdfff;
+        attribute1 = sprite->attribute1 & 0xdfff;
+    }
+
+    if (attribute1 != sprite->attribute1) {
+        sprite->attribute1 = attribute1;
+        sprite_mark_dirty(sprite);
     }
 }
 
 /* change the vertical flip flag */
 void sprite_set_horizontal_flip(struct Sprite* sprite, int horizontal_flip) {
+    unsigned short attribute1;
     if (horizontal_flip) {
         /* set the bit */
-        sprite->attribute1 |= 0x1000;
+        attribute1 = sprite->attribute1 | 0x1000;
     } else {
         /* clear the bit */
-        sprite->attribute1 &= 0xefff;
+        attribute1 = sprite->attribute1 & 0xefff;
+    }
+
+    if (attribute1 != sprite->attribute1) {
+        sprite->attribute1 = attribute1;
+        sprite_mark_dirty(sprite);
     }
 }
 
-/* change the tile offset of a sprite */
-void sprite_set_offset(struct Sprite* sprite, int offset) {
-    /* clear the old offset */
-    sprite->attribute2 &= 0xfc00;
+/* change the tile offset of a sprite, the player's animation does each frame */
+IWRAM_CODE void sprite_set_offset(struct Sprite* sprite, int offset) {
+    /* clear the old offset and apply the new one */
+    unsigned short attribute2 = (sprite->attribute2 & 0xfc00) | (offset & 0x03ff);
 
-    /* apply the new one */
-    sprite->attribute2 |= (offset & 0x03ff);
+    if (attribute2 != sprite->attribute2) {
+        sprite->attribute2 = attribute2;
+        sprite_mark_dirty(sprite);
+    }
 }
 
 /* setup the sprite image and palette */
@@ -497,17 +1390,6 @@ struct Player {
 
 };
 
-void enemy_init(struct Player* enemy, int x, int y) {
-    enemy->x = x << 8;
-    enemy->y = y << 8;
-    enemy->frame = 4;
-    enemy->animation_delay = 2147483647;    //hot fix for flashing sprite
-    enemy->counter = 0;                     //need to modify the update player
-    enemy->move = 0;                        //function for cleaner fix
-    enemy->border = 32;
-    enemy->sprite = sprite_init(enemy->x >> 8, enemy->y >> 8, SIZE_16_8, 0, 0, enemy->frame, 0);
-}
-
 void player_init(struct Player* player) {
     player->x = 100 << 8;
     player->y = 113 << 8;
@@ -533,19 +1415,6 @@ int player_left(struct Player* player) {
     }
 }
 
-int enemy_left(struct Player* enemy) {
-    sprite_set_horizontal_flip(enemy->sprite, 1);
-    enemy->move = 1;
-
-    if ((enemy->x >> 8) <= 0 - enemy->border)
-        return 1;
-    else {
-        enemy->x -= 256;
-        //player->x--;
-        return 0;
-    }
-}
-
 //Assembly function
 
 int is_player_right_border(int x, int border, int screen);
@@ -572,18 +1441,6 @@ int player_right(struct Player* player) {
 	}
 }
 
-int enemy_right(struct Player* enemy) {
-    sprite_set_horizontal_flip(enemy->sprite, 0);
-    enemy->move = 1;
-
-    if ((enemy->x >> 8) >= SCREEN_WIDTH)
-        return 1;
-    else{
-        enemy->x += 256;
-        return 0;
-    }
-}
-
 int player_up(struct Player* player) {
     player->move = 1;
 
@@ -598,7 +1455,7 @@ int player_up(struct Player* player) {
 int player_down(struct Player* player) {
     player->move = 1;
 
-    if ((player->y >> 8) >= (SCREEN_HEIGHT * 0.75))
+    if (player->y >= SCREEN_HEIGHT * FIXED8(0.75))
         return 1;
     else
         player->y += 256*2;
@@ -613,7 +1470,7 @@ void player_stop(struct Player* player) {
 }
 
 // finds which tile a screen coordinate maps to, taking scroll into account
-unsigned short tile_lookup(int x, int y, int xscroll, int yscroll,
+IWRAM_CODE unsigned short tile_lookup(int x, int y, int xscroll, int yscroll,
         const unsigned short* tilemap, int tilemap_w, int tilemap_h) {
 
     // adjust for the scroll
@@ -645,7 +1502,7 @@ unsigned short tile_lookup(int x, int y, int xscroll, int yscroll,
     return tilemap[index];
 }
 
-void player_update(struct Player* player) //player = 0 if enemy
+IWRAM_CODE void player_update(struct Player* player) //player = 0 if enemy
 {
 
     if(player->move)
@@ -666,155 +1523,387 @@ void player_update(struct Player* player) //player = 0 if enemy
 
 }
 
-void xorshift(unsigned int*);
+/* the player takes up one of the sprites, the enemies can have the rest */
+#define MAX_ENEMIES (NUM_SPRITES - 1)
 
-/* the main function */
-int main() {
-    /* we set the mode to mode 0 with bg0 on */
-    *display_control = MODE0 | BG0_ENABLE | BG1_ENABLE | SPRITE_ENABLE | SPRITE_MAP_1D;
+/* enemies only ever appear on one of the 8 pixel rows in the top 3/4 of the screen */
+#define ENEMY_ROWS (SCREEN_HEIGHT * 3 / 4 / 8)
 
-    // set up interrupt handler
-    *interrupt_enable = 0;
-    *interrupt_callback = (unsigned int) &on_vblank;
-    *interrupt_selection |= INTERRUPT_VBLANK;
-    *display_interrupts |= 0x08;
-    *interrupt_enable  = 1;
-    // clear the sound control
-    *sound_control = 0;
+/* marks the end of a row's list of enemies */
+#define NO_ENEMY 0xff
 
-    play_sound(music, music_bytes, 16000, 'A');
+/* the tile offset every enemy is drawn with, they don't animate */
+#define ENEMY_TILE 4
 
-    /* setup the background 0 */
-    setup_background();
+/* the enemies are kept as parallel arrays rather than an array of struct Player
+ * so the per frame update only touches the few bytes each enemy really uses */
+struct Enemies {
+    int count;
+    int x[MAX_ENEMIES];                 /* 8.8 fixed point */
+    unsigned char y[MAX_ENEMIES];       /* whole pixels, always on an 8 pixel row */
+    unsigned char sprite[MAX_ENEMIES];  /* index into sprites[] */
 
-    // setup the sprite image data 
-    setup_sprite_image();
+    /* each row keeps a doubly linked list of the enemies on it, so collision
+     * checks only have to look at the rows near what they're testing */
+    unsigned char row_first[ENEMY_ROWS];
+    unsigned char row_next[MAX_ENEMIES];
+    unsigned char row_prev[MAX_ENEMIES];
+};
 
-    // clear all the sprites on screen now 
-    sprite_clear();
+struct Enemies enemies;
 
-    struct Player player;
-    player_init(&player);
+/* put an enemy on the list for the row it's on */
+IWRAM_CODE void enemy_row_insert(int i) {
+    int row = enemies.y[i] >> 3;
+    int first = enemies.row_first[row];
+
+    enemies.row_prev[i] = NO_ENEMY;
+    enemies.row_next[i] = first;
+    if (first != NO_ENEMY) {
+        enemies.row_prev[first] = i;
+    }
+    enemies.row_first[row] = i;
+}
 
-    struct Player enemy, enemy2;
-    enemy_init(&enemy, 0, 0);
+/* take an enemy off the list for the row it's on */
+IWRAM_CODE void enemy_row_remove(int i) {
+    int prev = enemies.row_prev[i];
+    int next = enemies.row_next[i];
 
-    unsigned int seed = 0, score = 0;
+    if (prev == NO_ENEMY) {
+        enemies.row_first[enemies.y[i] >> 3] = next;
+    } else {
+        enemies.row_next[prev] = next;
+    }
+    if (next != NO_ENEMY) {
+        enemies.row_prev[next] = prev;
+    }
+}
 
-    int num_enemies = 1;
+/* remove all of the enemies, giving back their sprites */
+void enemy_clear() {
+    for (int i = 0; i < enemies.count; i++) {
+        sprite_free(&sprites[enemies.sprite[i]]);
+    }
+    enemies.count = 0;
+    for (int row = 0; row < ENEMY_ROWS; row++) {
+        enemies.row_first[row] = NO_ENEMY;
+    }
+}
 
-    int max_enemies = 128;
-    struct Player enemies[max_enemies];
-    enemies[0] = enemy;
-    int difficulty = 1;
+/* add an enemy at a pixel position, returns 0 if there's no room left for it */
+int enemy_spawn(int x, int y) {
+    if (enemies.count == MAX_ENEMIES) {
+        return 0;
+    }
 
-    // set initial scroll to 0 
-    int xscroll = 0;
-    int yscroll = 0;
-    unsigned int vblank_counter = 0;
-    
-    char done = 0;
-    while (!done) {
-        if (!seed)
-            seed = player.x * player.y;
-        int last_x = xscroll;
-        if (button_pressed(BUTTON_RIGHT)) {
-            if (player_right(&player)) {
-                xscroll += 2;
+    struct Sprite* sprite = sprite_init(x & 0x1ff, y, SIZE_16_8, 0, 0, ENEMY_TILE, 0);
+    if (sprite == NULL) {
+        return 0;
+    }
+
+    int i = enemies.count++;
+    enemies.x[i] = x << 8;
+    enemies.y[i] = y;
+    enemies.sprite[i] = sprite - sprites;
+    enemy_row_insert(i);
+    return 1;
+}
+
+/* find an enemy, other than skip, whose position is within reach_x and
+ * reach_y pixels of (x, y) - returns its index or -1 if there are none
+ * this only walks the rows that are in reach, not every enemy */
+IWRAM_CODE int enemy_find_near(int x, int y, int reach_x, int reach_y, int skip) {
+    /* the rows whose y is in [y - reach_y, y + reach_y] */
+    int first = (y - reach_y + 7) >> 3;
+    int last = (y + reach_y) >> 3;
+    if (first < 0) {
+        first = 0;
+    }
+    if (last >= ENEMY_ROWS) {
+        last = ENEMY_ROWS - 1;
+    }
+
+    for (int row = first; row <= last; row++) {
+        for (int i = enemies.row_first[row]; i != NO_ENEMY; i = enemies.row_next[i]) {
+            /* a single unsigned compare checks both sides of x */
+            unsigned int dx = (enemies.x[i] >> 8) - x + reach_x;
+            if (i != skip && dx <= (unsigned int) (2 * reach_x)) {
+                return i;
             }
         }
-        if (button_pressed(BUTTON_LEFT)) {
-            if (player_left(&player)) {
-                xscroll -= 2;
-            }
+    }
+
+    return -1;
+}
+
+/* move every enemy by step (8.8), respawning the ones that went off the right
+ * side of the screen, and write them into the shadow OAM - all in one pass */
+IWRAM_CODE void enemy_update_all(int step, struct Rng* rng) {
+    for (int i = 0; i < enemies.count; i++) {
+        int x = enemies.x[i] + step;
+
+        /* start over on a random row at the left side */
+        if ((x >> 8) >= SCREEN_WIDTH) {
+            enemy_row_remove(i);
+            enemies.y[i] = rng_range(rng, ENEMY_ROWS) * 8;
+            enemy_row_insert(i);
+            x = 0;
         }
-        if (button_pressed(BUTTON_DOWN))
-            player_down(&player);
-        if (button_pressed(BUTTON_UP))
-            player_up(&player);
-        if (!button_pressed(BUTTON_LEFT | BUTTON_RIGHT | BUTTON_UP | BUTTON_DOWN)) {
-            player_stop(&player);
+        enemies.x[i] = x;
+
+        sprite_position(&sprites[enemies.sprite[i]], x >> 8, enemies.y[i]);
+    }
+}
+
+/* the cartridge's SRAM, where the game records the buttons as it's played
+ * (see replay.h) - it's on an 8 bit bus, so it's only ever accessed a byte
+ * at a time */
+volatile unsigned char* save_memory = (volatile unsigned char*) GBA_MEMORY(0xE000000);
+
+/* emulators and flash carts look for this string in the ROM to know the
+ * cartridge has SRAM to keep */
+__attribute__((used, aligned(4))) const char save_type[] = "SRAM_V113";
+
+/* a recording being made or played back */
+struct Replay {
+    const volatile unsigned char* data;    /* the one playing, or 0 if recording */
+    unsigned int runs, run;                 /* how many there are, and which this is */
+    unsigned int steps;                     /* steps left in this run, or taken in it */
+    int started;
+} replay;
+
+/* a little endian field of a recording */
+unsigned int replay_read(const volatile unsigned char* at, int bytes) {
+    unsigned int value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | at[i];
+    }
+    return value;
+}
+
+void replay_write(volatile unsigned char* at, unsigned int value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        at[i] = value >> (i * 8);
+    }
+}
+
+/* start playing back a recording, or recording into SRAM if data is 0 */
+void replay_start(const unsigned char* data) {
+    replay.data = data;
+    replay.runs = data ? replay_read(data + REPLAY_RUNS, 4) : 0;
+    replay.run = 0;
+    replay.steps = 0;
+    replay.started = 0;
+}
+
+/* read the buttons for the next step into buttons_held, either from the
+ * register, recording them, or from the recording being played back, which
+ * also sets the seed on the first step - returns 0 once the recording has
+ * run out */
+int replay_step(unsigned int* seed) {
+    if (replay.data) {
+        if (!replay.started) {
+            *seed = replay_read(replay.data + REPLAY_SEED, 4);
+            replay.started = 1;
         }
 
-        if (last_x == xscroll)
-            for (int i = 0; i < num_enemies; i++)
-            {
-                enemy_right(&enemies[i]);
-                enemies[i].x += 256 * num_enemies;
-            }
-        else if (last_x < xscroll)
-            for (int i = 0; i < num_enemies; i++)
-                enemies[i].x += 256 * num_enemies - (384);
-        else {
-            for (int i = 0; i < num_enemies; i++) {
-                enemy_right(&enemies[i]);
-                enemies[i].x += 256 * num_enemies;
+        /* move on to the next run once this one is used up */
+        while (replay.steps == 0) {
+            if (replay.run == replay.runs) {
+                return 0;
             }
+            const volatile unsigned char* run =
+                replay.data + REPLAY_HEADER_BYTES + replay.run * REPLAY_RUN_BYTES;
+            buttons_held = replay_read(run, 2);
+            replay.steps = replay_read(run + 2, 2);
+            replay.run++;
         }
-        for (int i = 0; i < num_enemies; i++) {
-            if ((enemies[i].x >> 8) == SCREEN_WIDTH) {
-                xorshift(&seed);
-                int range = (SCREEN_HEIGHT * 0.75 / 8);
-                enemies[i].y = ((abs(seed) % range) * 8) << 8;
-                enemies[i].x = 0;
-            }
+        replay.steps--;
+        return 1;
+    }
+
+    buttons_held = *buttons;
+
+    if (!replay.started) {
+        for (int i = 0; i < REPLAY_MAGIC_BYTES; i++) {
+            save_memory[i] = REPLAY_MAGIC[i];
         }
-        // Add a new enemy every ~10 seconds
-        if (vblank_counter != 0 && vblank_counter % 600 == 0 && num_enemies < max_enemies) {
-            for (int i = 0; i < difficulty; i++) {
-                xorshift(&seed);
-                int range = (SCREEN_HEIGHT * 0.75 / 8);
-                struct Player new_enemy;
-                enemy_init(&new_enemy, 0, (abs(seed) % range) * 8);
-                new_enemy.x -= ((abs(seed)) % 32) << 8;
-                enemies[num_enemies] = new_enemy;
-                num_enemies++;
-                score++;
-            }
-            difficulty *= 2;
+        replay_write(save_memory + REPLAY_SEED, *seed, 4);
+        replay_write(save_memory + REPLAY_RUNS, 0, 4);
+        replay.started = 1;
+    }
 
+    /* keep adding to the last run while the buttons stay the same, or start
+     * a new one - once SRAM is full this just stops recording */
+    volatile unsigned char* runs = save_memory + REPLAY_HEADER_BYTES;
+    if (replay.runs > 0 && replay.steps < REPLAY_RUN_STEPS &&
+            replay_read(runs + (replay.runs - 1) * REPLAY_RUN_BYTES, 2) == buttons_held) {
+        replay.steps++;
+    } else if (replay.runs < REPLAY_MAX_RUNS) {
+        replay_write(runs + replay.runs * REPLAY_RUN_BYTES, buttons_held, 2);
+        replay.runs++;
+        replay.steps = 1;
+        replay_write(save_memory + REPLAY_RUNS, replay.runs, 4);
+    } else {
+        return 1;
+    }
+    replay_write(runs + (replay.runs - 1) * REPLAY_RUN_BYTES + 2, replay.steps, 2);
+    return 1;
+}
+
+/* how many steps between each wave of new enemies, and how many times bigger
+ * each wave is than the last - tools/difficulty.c is built with others to
+ * try out different curves */
+#ifndef SPAWN_INTERVAL
+#define SPAWN_INTERVAL 600
+#endif
+#ifndef SPAWN_GROWTH
+#define SPAWN_GROWTH 2
+#endif
+
+/* everything about a game in progress */
+struct Game {
+    struct Player player;
+    unsigned int seed, score;   /* the seed the game starts from, 0 to pick one */
+    struct Rng rng;             /* the enemies' random numbers */
+    int difficulty;
+    int xscroll, yscroll;
+    unsigned int vblank_counter;
+    unsigned int next_spawn;
+    int done;
+};
+
+/* start a new game with the player and a single enemy, playing back the
+ * recording in data, or recording this game if it's 0 */
+void game_init(struct Game* game, const unsigned char* data) {
+    // the last game's enemies go, then all the sprites on screen
+    enemy_clear();
+    sprite_clear();
+
+    player_init(&game->player);
+
+    enemy_spawn(0, 0);
+
+    game->seed = 0;
+    game->score = 0;
+    game->difficulty = 1;
+
+    // set initial scroll to 0 
+    game->xscroll = 0;
+    game->yscroll = 0;
+    game->vblank_counter = 0;
+    game->next_spawn = SPAWN_INTERVAL;
+    game->done = 0;
+
+    replay_start(data);
+}
+
+/* one step of the game: read the buttons, move the enemies, check for a
+ * collision and spawn the next wave when it's due - a recording being
+ * played back ends the game when it runs out */
+void game_update(struct Game* game) {
+    struct Player* player = &game->player;
+
+    if (!game->seed)
+        game->seed = player->x * player->y;
+    if (!replay_step(&game->seed)) {
+        game->done = 1;
+        return;
+    }
+
+    /* the random numbers start on the first step, once a recording being
+     * played back has had its say - this is the same sequence as xorshift's,
+     * so recordings play back just as they did */
+    if (game->vblank_counter == 0) {
+        rng_seed_xorshift32(&game->rng, game->seed);
+    }
+    int last_x = game->xscroll;
+    if (button_pressed(BUTTON_RIGHT)) {
+        if (player_right(player)) {
+            game->xscroll += 2;
         }
-        // wait for vblank before scrolling and moving sprites 
-        wait_vblank();
-        vblank_counter++;
-        *bg0_x_scroll = 0.25 * xscroll;
-        *bg1_x_scroll = xscroll;
-        player_update(&player);
-        for (int i = 0; i < num_enemies; i++) {
-            if (abs((enemies[i].x >> 8) - (player.x >> 8)) <= 16 && abs((enemies[i].y >> 8) - (player.y >> 8)) <= 8)
-                done = 1;
-            player_update(&enemies[i]);
+    }
+    if (button_pressed(BUTTON_LEFT)) {
+        if (player_left(player)) {
+            game->xscroll -= 2;
         }
-        //player_update(get(list, i));
-        sprite_update_all();
-
-        // delay some 
-        delay(700);
-    }
-}
-
-/* the game boy advance uses "interrupts" to handle certain situations
- * for now we will ignore these */
-void interrupt_ignore() {
-    /* do nothing */
-}
-
-/* this table specifies which interrupts we handle which way
- * for now, we ignore all of them */
-typedef void (*intrp)();
-const intrp IntrTable[13] = {
-    interrupt_ignore,   /* V Blank interrupt */
-    interrupt_ignore,   /* H Blank interrupt */
-    interrupt_ignore,   /* V Counter interrupt */
-    interrupt_ignore,   /* Timer 0 interrupt */
-    interrupt_ignore,   /* Timer 1 interrupt */
-    interrupt_ignore,   /* Timer 2 interrupt */
-    interrupt_ignore,   /* Timer 3 interrupt */
-    interrupt_ignore,   /* Serial communication interrupt */
-    interrupt_ignore,   /* DMA 0 interrupt */
-    interrupt_ignore,   /* DMA 1 interrupt */
-    interrupt_ignore,   /* DMA 2 interrupt */
-    interrupt_ignore,   /* DMA 3 interrupt */
-    interrupt_ignore,   /* Key interrupt */
-};
+    }
+    if (button_pressed(BUTTON_DOWN))
+        player_down(player);
+    if (button_pressed(BUTTON_UP))
+        player_up(player);
+    if (!button_pressed(BUTTON_LEFT | BUTTON_RIGHT | BUTTON_UP | BUTTON_DOWN)) {
+        player_stop(player);
+    }
+
+    // enemies fly right, but drift back while the screen scrolls right
+    int step = 256 * (enemies.count + 1);
+    if (last_x < game->xscroll)
+        step = 256 * enemies.count - (384);
+    enemy_update_all(step, &game->rng);
+    if (enemy_find_near(player->x >> 8, player->y >> 8, 16, 8, -1) >= 0)
+        game->done = 1;
+
+    // Add a new enemy every ~10 seconds
+    if (game->vblank_counter == game->next_spawn) {
+        game->next_spawn += SPAWN_INTERVAL;
+        if (enemies.count < MAX_ENEMIES) {
+            for (int i = 0; i < game->difficulty; i++) {
+                int row = rng_range(&game->rng, ENEMY_ROWS);
+                if (!enemy_spawn(-(int) (rng_last(&game->rng) & 31), row * 8))
+                    break;
+                game->score++;
+            }
+            game->difficulty *= SPAWN_GROWTH;
+        }
+    }
+}
+
+/* put the step on screen, which has to be done during the vblank */
+void game_draw(struct Game* game) {
+    parallax_update(game->xscroll);
+    player_update(&game->player);
+    //player_update(get(list, i));
+    sprite_update_all();
+}
+
+/* the main function, which the host benchmark leaves out (see tools/bench.c) */
+#ifndef DEFENDER_NO_MAIN
+int main() {
+    /* we set the mode to mode 0 with bg0 on */
+    *display_control = MODE0 | BG0_ENABLE | BG1_ENABLE | SPRITE_ENABLE | SPRITE_MAP_1D;
+
+    // set up interrupt handler
+    interrupt_init();
+    interrupt_set(IRQ_VBLANK, on_vblank);
+    // clear the sound control
+    *sound_control = 0;
 
+    // start the music looping on the mixer
+    mixer_init();
+    stream_play(music_adpcm, music_adpcm_samples, MIXER_STEP(MUSIC_SAMPLE_RATE), MIXER_MAX_VOLUME);
+
+    /* setup the background 0 */
+    setup_background();
+
+    // setup the sprite image data 
+    setup_sprite_image();
+
+    struct Game game;
+#ifdef REPLAY_HEADER
+    game_init(&game, replay_data);
+#else
+    game_init(&game, platform_replay());
+#endif
+
+    while (!game.done) {
+        game_update(&game);
+
+        // wait for vblank before scrolling and moving sprites 
+        wait_step();
+        game.vblank_counter++;
+        game_draw(&game);
+    }
+}
+#endif
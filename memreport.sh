@@ -0,0 +1,57 @@
+#!/bin/sh
+# memreport.sh
+# prints how much of IWRAM, EWRAM and ROM a linked program uses, and which
+# symbols are taking it up, largest first
+#
+# usage: ./memreport.sh defender.elf
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 program.elf" >&2
+    exit 1
+fi
+
+NM=${NM:-arm-none-eabi-nm}
+
+$NM --print-size --size-sort --reverse-sort "$1" | awk '
+# not every awk has strtonum
+function hex(text,    i, value) {
+    value = 0
+    text = tolower(text)
+    for (i = 1; i <= length(text); i++) {
+        value = value * 16 + index("0123456789abcdef", substr(text, i, 1)) - 1
+    }
+    return value
+}
+
+# 0x08000000, 0x03000000 and 0x02000000, awk has no hex constants
+function region(address) {
+    if (address >= 134217728) return "ROM"
+    if (address >= 50331648) return "IWRAM"
+    if (address >= 33554432) return "EWRAM"
+    return ""
+}
+
+# only the symbols which have a size
+NF == 4 {
+    address = hex($1)
+    size = hex($2)
+    where = region(address)
+    if (where == "") next
+
+    total[where] += size
+    lines[where] = lines[where] sprintf("  %8d  %s  %s\n", size, $3, $4)
+}
+
+END {
+    limit["IWRAM"] = 32 * 1024
+    limit["EWRAM"] = 256 * 1024
+    limit["ROM"] = 32 * 1024 * 1024
+
+    split("IWRAM EWRAM ROM", order, " ")
+    for (i = 1; i <= 3; i++) {
+        where = order[i]
+        printf "%-5s %8d of %8d bytes (%.1f%%)\n", where, total[where], limit[where],
+            100.0 * total[where] / limit[where]
+        printf "%s\n", lines[where]
+    }
+}'
@@ -0,0 +1,105 @@
+/* platform.h
+ * where the GBA's hardware lives, so the game can also be built for a PC
+ *
+ * on the GBA the registers, palette, VRAM and OAM are at fixed addresses, and
+ * GBA_MEMORY just turns the address into a pointer, so every store is the
+ * same MMIO store as before - built with PLATFORM_HOST, each of those regions
+ * is an array in platform_host.c instead, which also plays the part of the
+ * scanline counter, timers, DMA and interrupts (see there)
+ *
+ * tools/runner.c instead maps memory at the GBA's own addresses, so the game
+ * is built just as for the GBA, and only the simulated hardware is built
+ * with PLATFORM_MAPPED
+ *
+ * the host build has to be linked with -no-pie, so that the game's globals
+ * sit below 4G and their addresses fit in the 32 bit DMA registers */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#ifdef PLATFORM_HOST
+
+#include <stdint.h>
+
+/* the simulated memory, each starts at the beginning of its GBA region */
+extern unsigned char platform_ewram[0x40000];
+extern unsigned char platform_iwram[0x8000];
+extern unsigned char platform_io[0x400];
+extern unsigned char platform_palette[0x400];
+extern unsigned char platform_vram[0x18000];
+extern unsigned char platform_oam[0x400];
+extern unsigned char platform_sram[0x8000];
+
+/* the pointer for a GBA address, this still folds to a constant so it can
+ * be used to initialize the register globals */
+#define GBA_MEMORY(address) \
+    ((address) >= 0xE000000 ? (void*) (platform_sram + ((address) & 0x7fff)) : \
+     (address) >= 0x7000000 ? (void*) (platform_oam + ((address) & 0x3ff)) : \
+     (address) >= 0x6000000 ? (void*) (platform_vram + ((address) & 0x1ffff)) : \
+     (address) >= 0x5000000 ? (void*) (platform_palette + ((address) & 0x3ff)) : \
+     (address) >= 0x4000000 ? (void*) (platform_io + ((address) & 0x3ff)) : \
+     (address) >= 0x3000000 ? (void*) (platform_iwram + ((address) & 0x7fff)) : \
+     (void*) (platform_ewram + ((address) & 0x3ffff)))
+
+/* the GBA address of a pointer, for handing to DMA or the BIOS */
+unsigned int platform_address(const volatile void* pointer);
+#define GBA_ADDRESS(pointer) platform_address(pointer)
+
+/* tell the simulated DMA controller a channel's control register was just
+ * written, since plain memory can't notice the store by itself */
+#define platform_dma_written(channel) platform_dma_start(channel)
+
+#else
+
+/* on the GBA, and in tools/runner.c which maps memory at the same addresses */
+#define GBA_MEMORY(address) (address)
+#define GBA_ADDRESS(pointer) ((unsigned int) (pointer))
+
+/* the real DMA controller starts on the store, there is nothing else to do */
+#define platform_dma_written(channel) ((void) 0)
+
+#endif
+
+#if defined(PLATFORM_HOST) || defined(PLATFORM_MAPPED)
+
+#ifdef PLATFORM_MAPPED
+/* tools/runner.c maps the regions at their real addresses, but the game can
+ * only read the registers there, so its writes can be caught - the simulated
+ * hardware writes them through this second mapping of the same memory */
+extern unsigned char* platform_io;
+#endif
+
+/* start a DMA channel, with the addresses and control already written */
+void platform_dma_start(int channel);
+
+/* run the simulated hardware on for some scanlines, firing the interrupts,
+ * timers and DMA transfers which come due */
+void platform_scanlines(int count);
+
+/* add a write to the trace, if DEFENDER_TRACE asked for one - game is set
+ * for writes made by the game's code rather than by the hardware itself */
+void platform_trace(int kind, int channel, unsigned int address, unsigned int bytes, int game);
+
+/* hold down buttons, using the BUTTON_ bits from main.c */
+void platform_set_buttons(unsigned short pressed);
+
+/* how many frames have been simulated */
+extern unsigned int platform_frames;
+
+/* keep each sample a sound FIFO (0 for A, 1 for B) plays from now on in
+ * samples, up to size of them - platform_captured says how many there are */
+void platform_capture_sound(int channel, signed char* samples, unsigned int size);
+unsigned int platform_captured(int channel);
+
+/* the recording DEFENDER_REPLAY names, for the game to play back instead of
+ * reading the buttons, or 0 if there isn't one (see replay.h) */
+const unsigned char* platform_replay();
+
+#else
+
+/* on the GBA a recording is built into the ROM instead, see main.c */
+#define platform_replay() ((const unsigned char*) 0)
+
+#endif
+
+#endif
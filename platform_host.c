@@ -0,0 +1,724 @@
+/* platform_host.c
+ * the hardware side of the game when it's built for a PC with PLATFORM_HOST
+ * (see platform.h) - the GBA's memory regions are arrays here, and time only
+ * moves on when the game waits for a vblank, a scanline at a time
+ *
+ * each scanline this counts VCOUNT up, flags and raises the display
+ * interrupts, runs the timers, and has DMA hand the sound FIFOs samples when
+ * they run low - it doesn't draw anything, and it is only as exact as the
+ * game needs: timers are counted a whole scanline at a time, and reading a
+ * timer's data register gives its reload value, not the count
+ *
+ * setting DEFENDER_TRACE to a file name records every DMA transfer in it,
+ * and in tools/runner.c every register store as well (see trace.h) - the
+ * game's code takes no time here, so to see how far into the frame its
+ * writes would land on a GBA, set DEFENDER_CYCLES_PER_NS to how many GBA
+ * cycles a host ns is worth (tools/bench.c prints this) and the scanline is
+ * estimated from the time since the last vblank
+ *
+ * setting DEFENDER_PPM to a directory draws each frame into it with ppu.c,
+ * as frame00000.ppm and so on - DEFENDER_PPM_EVERY draws every nth frame
+ * instead, and DEFENDER_THREADS shares the drawing between threads
+ * DEFENDER_GOLDEN names a directory of frames written that way before, and
+ * each frame drawn is compared with the one of the same name in it, if
+ * there is one - the program fails at the end if any of them differ
+ *
+ * setting DEFENDER_REPLAY to a recording (see replay.h) plays it back
+ * instead of reading the buttons, and the game ends when it runs out -
+ * DEFENDER_RECORD names a file to save what the game recorded into SRAM to
+ * when it exits, like the save file of an emulator
+ *
+ * this also has C versions of the assembly functions, and the BIOS call */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
+#include "ppu.h"
+#include "replay.h"
+#include "trace.h"
+
+/* how big each region is */
+#define EWRAM_SIZE 0x40000
+#define IWRAM_SIZE 0x8000
+#define IO_SIZE 0x400
+#define PALETTE_SIZE 0x400
+#define VRAM_SIZE 0x18000
+#define OAM_SIZE 0x400
+
+#ifdef PLATFORM_MAPPED
+
+/* tools/runner.c maps these where the GBA has them, and sets platform_io */
+unsigned char* const platform_ewram = (unsigned char*) 0x2000000;
+unsigned char* const platform_iwram = (unsigned char*) 0x3000000;
+unsigned char* platform_io;
+unsigned char* const platform_palette = (unsigned char*) 0x5000000;
+unsigned char* const platform_vram = (unsigned char*) 0x6000000;
+unsigned char* const platform_oam = (unsigned char*) 0x7000000;
+unsigned char* const platform_sram = (unsigned char*) 0xE000000;
+
+#else
+
+unsigned char platform_ewram[EWRAM_SIZE];
+unsigned char platform_iwram[IWRAM_SIZE];
+unsigned char platform_palette[PALETTE_SIZE];
+unsigned char platform_vram[VRAM_SIZE];
+unsigned char platform_oam[OAM_SIZE];
+unsigned char platform_sram[REPLAY_SRAM_BYTES];
+
+/* KEYINPUT reads 1 for each button that isn't pressed */
+unsigned char platform_io[IO_SIZE] = {[0x130] = 0xff, [0x131] = 0x03};
+
+#endif
+
+unsigned int platform_frames = 0;
+
+/* the registers this uses, as offsets into platform_io */
+#define IO_DISPSTAT 0x004
+#define IO_VCOUNT 0x006
+#define IO_SOUNDCNT_H 0x082
+#define IO_FIFO_A 0x0a0
+#define IO_FIFO_B 0x0a4
+#define IO_DMA0 0x0b0
+#define IO_TIMER0 0x100
+#define IO_KEYINPUT 0x130
+#define IO_IE 0x200
+#define IO_IF 0x202
+#define IO_IME 0x208
+
+/* the BIOS keeps its own copy of the interrupt flags and the handler here */
+#define IWRAM_BIOS_FLAGS 0x7ff8
+#define IWRAM_BIOS_HANDLER 0x7ffc
+
+#define CYCLES_PER_SCANLINE 1232
+#define SCANLINES 228
+#define VISIBLE_SCANLINES 160
+
+/* the 16 and 32 bit registers, which are always aligned */
+static unsigned short* io16(int offset) {
+    return (unsigned short*) (platform_io + offset);
+}
+
+static unsigned int* io32(int offset) {
+    return (unsigned int*) (platform_io + offset);
+}
+
+#ifdef PLATFORM_HOST
+
+/* the GBA address of a pointer, either in one of the simulated regions or one
+ * of the game's own globals, which -no-pie keeps below 4G */
+unsigned int platform_address(const volatile void* pointer) {
+    const unsigned char* p = (const unsigned char*) pointer;
+    static const struct {
+        unsigned char* memory;
+        unsigned int size, address;
+    } regions[] = {
+        {platform_ewram, EWRAM_SIZE, 0x2000000},
+        {platform_iwram, IWRAM_SIZE, 0x3000000},
+        {platform_io, IO_SIZE, 0x4000000},
+        {platform_palette, PALETTE_SIZE, 0x5000000},
+        {platform_vram, VRAM_SIZE, 0x6000000},
+        {platform_oam, OAM_SIZE, 0x7000000},
+        {platform_sram, REPLAY_SRAM_BYTES, 0xE000000},
+    };
+
+    for (unsigned int i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        if (p >= regions[i].memory && p < regions[i].memory + regions[i].size) {
+            return regions[i].address + (p - regions[i].memory);
+        }
+    }
+
+    if ((uintptr_t) p > 0xffffffffu) {
+        fprintf(stderr, "platform: %p doesn't fit in 32 bits, link with -no-pie\n", pointer);
+        abort();
+    }
+    return (uintptr_t) p;
+}
+
+#endif
+
+/* the trace file, if there is one */
+static FILE* trace_file = NULL;
+static int trace_opened = 0;
+
+/* for estimating where the game's own writes fall in the frame */
+static double trace_cycles_per_ns = 0;
+static double trace_wait_ns = 0;
+
+static double trace_now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static void trace_close() {
+    fclose(trace_file);
+}
+
+static void trace_open() {
+    trace_opened = 1;
+
+    const char* path = getenv("DEFENDER_TRACE");
+    if (!path) {
+        return;
+    }
+    trace_file = fopen(path, "wb");
+    if (!trace_file) {
+        perror(path);
+        exit(1);
+    }
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace_file);
+    atexit(trace_close);
+
+    const char* cycles = getenv("DEFENDER_CYCLES_PER_NS");
+    if (cycles) {
+        trace_cycles_per_ns = atof(cycles);
+    }
+    trace_wait_ns = trace_now();
+}
+
+void platform_trace(int kind, int channel, unsigned int address, unsigned int bytes, int game) {
+    if (!trace_opened) {
+        trace_open();
+    }
+    if (!trace_file) {
+        return;
+    }
+
+    struct TraceRecord record;
+    unsigned int line = *io16(IO_VCOUNT);
+    record.frame = platform_frames;
+
+    /* the game's code has been running since the last vblank wait returned */
+    if (game && trace_cycles_per_ns > 0) {
+        line += (trace_now() - trace_wait_ns) * trace_cycles_per_ns / CYCLES_PER_SCANLINE;
+        record.frame += line / SCANLINES;
+        line %= SCANLINES;
+    }
+
+    record.line = line;
+    record.kind = kind;
+    record.channel = channel;
+    record.unused = 0;
+    record.address = address;
+    record.bytes = bytes;
+    fwrite(&record, sizeof(record), 1, trace_file);
+}
+
+/* the pointer for an address from a DMA register */
+static unsigned char* platform_pointer(unsigned int address) {
+    switch (address >> 24) {
+        case 0x2: return platform_ewram + (address & 0x3ffff);
+        case 0x3: return platform_iwram + (address & 0x7fff);
+        case 0x4: return platform_io + (address & 0x3ff);
+        case 0x5: return platform_palette + (address & 0x3ff);
+        case 0x6: return platform_vram + (address & 0x1ffff) % VRAM_SIZE;
+        case 0x7: return platform_oam + (address & 0x3ff);
+        case 0xe: return platform_sram + (address & 0x7fff);
+        default: return (unsigned char*) (uintptr_t) address;
+    }
+}
+
+/* raise interrupt flags, and call the handler the game installed for as long
+ * as any that are enabled are pending, like the CPU would */
+static void platform_interrupt(unsigned short flags) {
+    *io16(IO_IF) |= flags;
+
+    while ((*io16(IO_IME) & 1) && (*io16(IO_IE) & *io16(IO_IF))) {
+        unsigned int handler = *(unsigned int*) (platform_iwram + IWRAM_BIOS_HANDLER);
+        if (handler == 0) {
+            return;
+        }
+        unsigned short before = *io16(IO_IF);
+        ((void (*)()) (uintptr_t) handler)();
+
+        /* a handler which doesn't acknowledge anything would loop forever */
+        if (*io16(IO_IF) == before) {
+            return;
+        }
+    }
+}
+
+/* the sound FIFOs, 32 samples each, which DMA refills 16 at a time */
+struct Fifo {
+    signed char samples[32];
+    int count, read;
+};
+
+static struct Fifo fifos[2];
+
+/* the last sample each FIFO played, and how many it has played */
+int platform_sound[2];
+unsigned int platform_samples[2];
+
+/* where platform_capture_sound is keeping each FIFO's samples */
+static struct {
+    signed char* samples;
+    unsigned int size, count;
+} captures[2];
+
+void platform_capture_sound(int channel, signed char* samples, unsigned int size) {
+    captures[channel].samples = samples;
+    captures[channel].size = size;
+    captures[channel].count = 0;
+}
+
+unsigned int platform_captured(int channel) {
+    return captures[channel].count;
+}
+
+static void fifo_push(int channel, signed char sample) {
+    struct Fifo* fifo = &fifos[channel];
+    if (fifo->count < 32) {
+        fifo->samples[(fifo->read + fifo->count++) & 31] = sample;
+    }
+}
+
+/* a channel of DMA, with the addresses and count it latched when started */
+struct Dma {
+    unsigned int source, destination, count;
+};
+
+static struct Dma dmas[4];
+
+static unsigned short dma_control(int channel) {
+    return *io16(IO_DMA0 + channel * 12 + 10);
+}
+
+/* move count units from one address to another as DMA channel would */
+static void dma_transfer(int channel, int count, int fifo) {
+    struct Dma* dma = &dmas[channel];
+    unsigned short control = dma_control(channel);
+    int size = (control & 0x400) ? 4 : 2;
+    int source_step = (control >> 7) & 3;
+    int destination_step = fifo ? 2 : (control >> 5) & 3;
+    int timing = (control >> 12) & 3;
+
+    platform_trace(timing == 2 ? TRACE_HBLANK : TRACE_DMA, channel, dma->destination, count * size,
+            timing == 0);
+
+    for (int i = 0; i < count; i++) {
+        unsigned char* from = platform_pointer(dma->source & ~(size - 1));
+        unsigned int to = dma->destination & ~(size - 1);
+
+        if ((to & ~3) == 0x4000000 + IO_FIFO_A || (to & ~3) == 0x4000000 + IO_FIFO_B) {
+            for (int j = 0; j < size; j++) {
+                fifo_push(to == 0x4000000 + IO_FIFO_B, from[j]);
+            }
+        } else {
+            memcpy(platform_pointer(to), from, size);
+        }
+
+        if (source_step == 0) {
+            dma->source += size;
+        } else if (source_step == 1) {
+            dma->source -= size;
+        }
+        if (destination_step == 0 || destination_step == 3) {
+            dma->destination += size;
+        } else if (destination_step == 1) {
+            dma->destination -= size;
+        }
+    }
+
+    /* repeating channels wait for their next turn, the rest are done */
+    if ((control & 0x200) && timing != 0) {
+        if (destination_step == 3) {
+            dma->destination = *io32(IO_DMA0 + channel * 12 + 4);
+        }
+    } else {
+        *io16(IO_DMA0 + channel * 12 + 10) &= ~0x8000;
+    }
+    if (control & 0x4000) {
+        platform_interrupt(1 << (8 + channel));
+    }
+}
+
+void platform_dma_start(int channel) {
+    unsigned short control = dma_control(channel);
+    if (!(control & 0x8000)) {
+        return;
+    }
+
+    struct Dma* dma = &dmas[channel];
+    dma->source = *io32(IO_DMA0 + channel * 12);
+    dma->destination = *io32(IO_DMA0 + channel * 12 + 4);
+    dma->count = *io16(IO_DMA0 + channel * 12 + 8);
+    if (dma->count == 0) {
+        dma->count = channel == 3 ? 0x10000 : 0x4000;
+    }
+
+    /* immediate transfers are over before the next instruction */
+    if (((control >> 12) & 3) == 0) {
+        dma_transfer(channel, dma->count, 0);
+    }
+}
+
+/* start the channels waiting on a vblank (1) or hblank (2) */
+static void dma_timing(int timing) {
+    for (int channel = 0; channel < 4; channel++) {
+        unsigned short control = dma_control(channel);
+        if ((control & 0x8000) && ((control >> 12) & 3) == timing) {
+            dma_transfer(channel, dmas[channel].count, 0);
+        }
+    }
+}
+
+/* play a sample from a FIFO, and have DMA 1 or 2 top it up once it's down
+ * to half full */
+static void fifo_pop(int channel) {
+    struct Fifo* fifo = &fifos[channel];
+    if (fifo->count > 0) {
+        platform_sound[channel] = fifo->samples[fifo->read];
+        fifo->read = (fifo->read + 1) & 31;
+        fifo->count--;
+    }
+    platform_samples[channel]++;
+    if (captures[channel].count < captures[channel].size) {
+        captures[channel].samples[captures[channel].count++] = platform_sound[channel];
+    }
+
+    if (fifo->count <= 16) {
+        unsigned int address = 0x4000000 + (channel ? IO_FIFO_B : IO_FIFO_A);
+        for (int dma = 1; dma <= 2; dma++) {
+            unsigned short control = dma_control(dma);
+            if ((control & 0x8000) && ((control >> 12) & 3) == 3 &&
+                    dmas[dma].destination == address) {
+                dma_transfer(dma, 4, 1);
+                break;
+            }
+        }
+    }
+}
+
+/* the count of each timer, and its control register as of the last scanline */
+static unsigned int timer_counts[4];
+static unsigned short timer_controls[4];
+
+/* a timer went past 0xffff */
+static void timer_overflow(int timer) {
+    unsigned short reset = *io16(IO_SOUNDCNT_H);
+
+    /* the FIFO reset bits empty the FIFO and always read back as 0 */
+    if (reset & 0x0800) {
+        fifos[0].count = 0;
+    }
+    if (reset & 0x8000) {
+        fifos[1].count = 0;
+    }
+    *io16(IO_SOUNDCNT_H) = reset & ~0x8800;
+
+    /* the FIFOs on this timer play a sample, if they're on at all */
+    if (timer < 2) {
+        if ((reset & 0x0300) && ((reset >> 10) & 1) == timer) {
+            fifo_pop(0);
+        }
+        if ((reset & 0x3000) && ((reset >> 14) & 1) == timer) {
+            fifo_pop(1);
+        }
+    }
+
+    if (timer_controls[timer] & 0x40) {
+        platform_interrupt(1 << (3 + timer));
+    }
+}
+
+/* count a timer up by ticks, along with the ones cascaded off it */
+static void timer_count(int timer, unsigned int ticks) {
+    unsigned short reload = *io16(IO_TIMER0 + timer * 4);
+    unsigned int overflows = 0;
+
+    timer_counts[timer] += ticks;
+    while (timer_counts[timer] >= 0x10000) {
+        timer_counts[timer] -= 0x10000 - reload;
+        timer_overflow(timer);
+        overflows++;
+    }
+
+    if (overflows && timer < 3 && (timer_controls[timer + 1] & 0x84) == 0x84) {
+        timer_count(timer + 1, overflows);
+    }
+}
+
+/* run each timer for a scanline's worth of cycles */
+static void timers_scanline() {
+    static const int prescale[4] = {0, 6, 8, 10};
+    static unsigned int cycles[4];
+
+    for (int timer = 0; timer < 4; timer++) {
+        unsigned short control = *io16(IO_TIMER0 + timer * 4 + 2);
+
+        /* a timer starts from its reload value when it's switched on */
+        if ((control & 0x80) && !(timer_controls[timer] & 0x80)) {
+            timer_counts[timer] = *io16(IO_TIMER0 + timer * 4);
+            cycles[timer] = 0;
+        }
+        timer_controls[timer] = control;
+    }
+
+    for (int timer = 0; timer < 4; timer++) {
+        unsigned short control = timer_controls[timer];
+        if (!(control & 0x80) || (timer > 0 && (control & 0x4))) {
+            continue;
+        }
+
+        int shift = prescale[control & 3];
+        cycles[timer] += CYCLES_PER_SCANLINE;
+        timer_count(timer, cycles[timer] >> shift);
+        cycles[timer] &= (1 << shift) - 1;
+    }
+}
+
+/* drawing frames with ppu.c, if DEFENDER_PPM or DEFENDER_GOLDEN is set */
+static struct PpuFrame ppu_frame;
+static int ppu_checked = 0, ppu_on = 0;
+static const char* ppu_directory;
+static const char* ppu_golden;
+static int ppu_every = 1, ppu_threads = 1;
+static unsigned int ppu_compared = 0, ppu_different = 0;
+
+/* say how the golden frames went, failing if any were different */
+static void ppu_finish() {
+    fprintf(stderr, "golden: %u of %u frames differ\n", ppu_different, ppu_compared);
+    if (ppu_different) {
+        fflush(NULL);
+        _Exit(1);
+    }
+}
+
+static void ppu_check() {
+    ppu_checked = 1;
+    ppu_directory = getenv("DEFENDER_PPM");
+    ppu_golden = getenv("DEFENDER_GOLDEN");
+    ppu_on = ppu_directory || ppu_golden;
+
+    const char* every = getenv("DEFENDER_PPM_EVERY");
+    if (every && atoi(every) > 0) {
+        ppu_every = atoi(every);
+    }
+    const char* threads = getenv("DEFENDER_THREADS");
+    if (threads && atoi(threads) > 0) {
+        ppu_threads = atoi(threads);
+    }
+    if (ppu_golden) {
+        atexit(ppu_finish);
+    }
+}
+
+/* draw the frame which has just finished, and write it out or compare it */
+static void ppu_draw(unsigned int frame) {
+    if (frame % ppu_every != 0) {
+        return;
+    }
+
+    struct PpuMemory memory = {platform_palette, platform_vram, platform_oam};
+    ppu_render(&memory, &ppu_frame, ppu_threads);
+
+    char path[4096];
+    if (ppu_directory) {
+        snprintf(path, sizeof(path), "%s/frame%05u.ppm", ppu_directory, frame);
+        if (!ppu_write_ppm(path, &ppu_frame)) {
+            perror(path);
+            exit(1);
+        }
+    }
+    if (ppu_golden) {
+        snprintf(path, sizeof(path), "%s/frame%05u.ppm", ppu_golden, frame);
+        long different = ppu_compare_ppm(path, &ppu_frame);
+        if (different >= 0) {
+            ppu_compared++;
+        }
+        if (different > 0) {
+            ppu_different++;
+            fprintf(stderr, "golden: frame %u has %ld pixels different from %s\n",
+                    frame, different, path);
+        }
+    }
+}
+
+void platform_scanlines(int count) {
+    if (!ppu_checked) {
+        ppu_check();
+    }
+
+    for (int i = 0; i < count; i++) {
+        unsigned short line = (*io16(IO_VCOUNT) + 1) % SCANLINES;
+        unsigned short status = *io16(IO_DISPSTAT);
+        unsigned short flags = 0;
+
+        *io16(IO_VCOUNT) = line;
+
+        /* the vblank flag is on for lines 160 to 226 */
+        status &= ~0x7;
+        if (line >= VISIBLE_SCANLINES && line < SCANLINES - 1) {
+            status |= 0x1;
+        }
+        if (line == (status >> 8)) {
+            status |= 0x4;
+            if (status & 0x20) {
+                flags |= 0x4;
+            }
+        }
+        *io16(IO_DISPSTAT) = status;
+
+        /* the line is drawn with the registers as they are now */
+        if (ppu_on && line < VISIBLE_SCANLINES) {
+            memcpy(ppu_frame.registers[line], platform_io, PPU_REGISTERS);
+        }
+
+        if (line == VISIBLE_SCANLINES) {
+            if (ppu_on) {
+                ppu_draw(platform_frames);
+            }
+            platform_frames++;
+            dma_timing(1);
+            if (status & 0x8) {
+                flags |= 0x1;
+            }
+        }
+        platform_interrupt(flags);
+
+        timers_scanline();
+
+        /* then the hblank at the end of the line */
+        *io16(IO_DISPSTAT) |= 0x2;
+        if (line < VISIBLE_SCANLINES) {
+            dma_timing(2);
+        }
+        if (status & 0x10) {
+            platform_interrupt(0x2);
+        }
+    }
+}
+
+/* the little endian run count from a recording's header */
+static unsigned int replay_runs(const unsigned char* header) {
+    return header[REPLAY_RUNS] | header[REPLAY_RUNS + 1] << 8 |
+        header[REPLAY_RUNS + 2] << 16 | (unsigned int) header[REPLAY_RUNS + 3] << 24;
+}
+
+static const char* replay_record_path = NULL;
+
+/* save the recording the game made in SRAM, without the unused rest */
+static void replay_save() {
+    if (memcmp(platform_sram, REPLAY_MAGIC, REPLAY_MAGIC_BYTES) != 0) {
+        fprintf(stderr, "%s: the game didn't record anything\n", replay_record_path);
+        return;
+    }
+
+    FILE* file = fopen(replay_record_path, "wb");
+    if (!file) {
+        perror(replay_record_path);
+        return;
+    }
+    fwrite(platform_sram, 1, REPLAY_HEADER_BYTES + replay_runs(platform_sram) * REPLAY_RUN_BYTES, file);
+    fclose(file);
+}
+
+const unsigned char* platform_replay() {
+    replay_record_path = getenv("DEFENDER_RECORD");
+    if (replay_record_path) {
+        atexit(replay_save);
+    }
+
+    const char* path = getenv("DEFENDER_REPLAY");
+    if (!path) {
+        return NULL;
+    }
+
+    /* a save file from an emulator is all of SRAM, so read up to that much
+     * and check the runs the header promises are all there */
+    static unsigned char data[REPLAY_SRAM_BYTES];
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+
+    if (size < REPLAY_HEADER_BYTES || memcmp(data, REPLAY_MAGIC, REPLAY_MAGIC_BYTES) != 0 ||
+            replay_runs(data) > (size - REPLAY_HEADER_BYTES) / REPLAY_RUN_BYTES) {
+        fprintf(stderr, "%s: not a recording\n", path);
+        exit(1);
+    }
+    return data;
+}
+
+void platform_set_buttons(unsigned short pressed) {
+    *io16(IO_KEYINPUT) = ~pressed & 0x3ff;
+}
+
+/* the BIOS VBlankIntrWait, from vblankintrwait.s - time passes while waiting
+ * here, and the game stops after DEFENDER_FRAMES frames if that is set */
+void vblank_intr_wait() {
+    static long frame_limit = -1;
+    if (frame_limit < 0) {
+        const char* frames = getenv("DEFENDER_FRAMES");
+        frame_limit = frames ? atol(frames) : 0;
+    }
+
+    unsigned short* flags = (unsigned short*) (platform_iwram + IWRAM_BIOS_FLAGS);
+    *flags &= ~1;
+    *io16(IO_IME) = 1;
+
+    for (int i = 0; !(*flags & 1); i++) {
+        if (i == 2 * SCANLINES) {
+            fprintf(stderr, "vblank_intr_wait: the vblank interrupt never came\n");
+            abort();
+        }
+        platform_scanlines(1);
+    }
+
+    if (frame_limit && platform_frames >= frame_limit) {
+        exit(0);
+    }
+    trace_wait_ns = trace_now();
+}
+
+/* interrupt.s, minus the nesting, as handlers here can't be interrupted */
+extern void (*interrupt_handlers[])();
+
+void interrupt_master() {
+    unsigned short pending = *io16(IO_IE) & *io16(IO_IF);
+
+    for (int source = 0; source < 14; source++) {
+        unsigned short bit = 1 << source;
+        if (pending & bit) {
+            *io16(IO_IF) &= ~bit;
+            *(unsigned short*) (platform_iwram + IWRAM_BIOS_FLAGS) |= bit;
+            if (interrupt_handlers[source]) {
+                interrupt_handlers[source]();
+            }
+            return;
+        }
+    }
+}
+
+/* xorshift.s */
+void xorshift(unsigned int* seed) {
+    unsigned int x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+}
+
+void xorshift_fill(unsigned int* seed, unsigned int* values, int count) {
+    unsigned int x = *seed;
+    for (int i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        values[i] = x;
+    }
+    *seed = x;
+}
+
+/* isplayerrightborder.s */
+int is_player_right_border(int x, int border, int screen) {
+    return (int) ((unsigned int) x >> 8) > screen - 16 - border;
+}
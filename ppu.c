@@ -0,0 +1,345 @@
+/* ppu.c
+ * the software renderer from ppu.h
+ *
+ * each line is drawn on its own, from the registers latched for it, so the
+ * lines can be shared between threads - a frame's lines go to a pool of
+ * threads which take the next undrawn line until there are none left */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ppu.h"
+
+/* the bits of DISPCNT this uses */
+#define DISPLAY_MODE 0x7
+#define DISPLAY_SPRITE_1D 0x40
+#define DISPLAY_BLANK 0x80
+#define DISPLAY_BG0 0x100
+#define DISPLAY_SPRITES 0x1000
+
+/* which layer is in front is decided by a rank, lower is nearer: priority
+ * first, then sprites in front of backgrounds, then lower backgrounds */
+#define RANK(priority, layer) ((priority) * 8 + (layer))
+#define RANK_SPRITE 0
+#define RANK_BACKDROP 0xff
+
+static unsigned short read16(const unsigned char* memory, unsigned int offset) {
+    return memory[offset] | (memory[offset + 1] << 8);
+}
+
+/* a background's pixels on this line, where they are in front of what's
+ * already there */
+static void draw_background(const struct PpuMemory* memory, const unsigned char* registers,
+        int bg, int line, unsigned short* pixels, unsigned char* ranks) {
+    unsigned short control = read16(registers, 0x08 + bg * 2);
+    int x_scroll = read16(registers, 0x10 + bg * 4) & 0x1ff;
+    int y_scroll = read16(registers, 0x12 + bg * 4) & 0x1ff;
+
+    int rank = RANK(control & 3, 1 + bg);
+    const unsigned char* tiles = memory->vram + ((control >> 2) & 3) * 0x4000;
+    const unsigned char* map = memory->vram + ((control >> 8) & 0x1f) * 0x800;
+    int colors256 = control & 0x80;
+    int size = control >> 14;
+
+    /* the map is made of 32x32 tile screen blocks, side by side when it's
+     * wide, and then below when it's tall */
+    int width = (size & 1) ? 512 : 256;
+    int height = (size & 2) ? 512 : 256;
+
+    int y = (line + y_scroll) & (height - 1);
+    for (int screen_x = 0; screen_x < PPU_WIDTH; screen_x++) {
+        int x = (screen_x + x_scroll) & (width - 1);
+
+        int block = (x >> 8) + (y >> 8) * (width >> 8);
+        unsigned short entry = read16(map, block * 0x800 + (((y & 255) >> 3) * 32 + ((x & 255) >> 3)) * 2);
+
+        int tile_x = (entry & 0x400) ? 7 - (x & 7) : x & 7;
+        int tile_y = (entry & 0x800) ? 7 - (y & 7) : y & 7;
+        int tile = entry & 0x3ff;
+
+        int color;
+        if (colors256) {
+            color = tiles[(tile * 64 + tile_y * 8 + tile_x) & 0xffff];
+        } else {
+            int pair = tiles[(tile * 32 + tile_y * 4 + tile_x / 2) & 0xffff];
+            color = (tile_x & 1) ? pair >> 4 : pair & 0xf;
+            if (color) {
+                color += (entry >> 12) * 16;
+            }
+        }
+
+        /* color 0 is see through */
+        if (color && rank < ranks[screen_x]) {
+            ranks[screen_x] = rank;
+            pixels[screen_x] = read16(memory->palette, color * 2);
+        }
+    }
+}
+
+/* the width and height of each sprite shape (square, wide, tall) and size */
+static const unsigned char sprite_sizes[3][4][2] = {
+    {{8, 8}, {16, 16}, {32, 32}, {64, 64}},
+    {{16, 8}, {32, 8}, {32, 16}, {64, 32}},
+    {{8, 16}, {8, 32}, {16, 32}, {32, 64}},
+};
+
+/* the sprites' pixels on this line - among sprites the lowest numbered one
+ * is in front, and only then does its priority count against the
+ * backgrounds, as on the GBA */
+static void draw_sprites(const struct PpuMemory* memory, int mapping_1d, int line,
+        unsigned short* pixels, unsigned char* ranks) {
+    unsigned short colors[PPU_WIDTH];
+    unsigned char priorities[PPU_WIDTH];
+    memset(priorities, 0xff, sizeof(priorities));
+
+    const unsigned char* tiles = memory->vram + 0x10000;
+    for (int i = 0; i < 128; i++) {
+        unsigned short attribute0 = read16(memory->oam, i * 8);
+        unsigned short attribute1 = read16(memory->oam, i * 8 + 2);
+        unsigned short attribute2 = read16(memory->oam, i * 8 + 4);
+
+        /* affine sprites aren't drawn, nor hidden ones, nor the bad shape */
+        int shape = attribute0 >> 14;
+        if ((attribute0 & 0x300) || shape == 3) {
+            continue;
+        }
+
+        int width = sprite_sizes[shape][attribute1 >> 14][0];
+        int height = sprite_sizes[shape][attribute1 >> 14][1];
+
+        /* y wraps around at 256 and x at 512 */
+        int row = (line - (attribute0 & 0xff)) & 0xff;
+        if (row >= height) {
+            continue;
+        }
+        if (attribute1 & 0x2000) {
+            row = height - 1 - row;
+        }
+        int left = attribute1 & 0x1ff;
+        if (left >= PPU_WIDTH) {
+            left -= 512;
+        }
+
+        int colors256 = attribute0 & 0x2000;
+        int tile = attribute2 & 0x3ff;
+        int priority = (attribute2 >> 10) & 3;
+
+        /* the tile row the line is in, in 32 byte units: in 1D mapping the
+         * sprite's tiles follow on from each other, in 2D each row of tiles
+         * starts 32 tiles further on */
+        int tile_width = colors256 ? 2 : 1;
+        int row_start = mapping_1d ? (row >> 3) * (width >> 3) * tile_width : (row >> 3) * 32;
+
+        for (int column = 0; column < width; column++) {
+            int screen_x = left + column;
+            if (screen_x < 0 || screen_x >= PPU_WIDTH || priorities[screen_x] != 0xff) {
+                continue;
+            }
+
+            int x = (attribute1 & 0x1000) ? width - 1 - column : column;
+            int offset = ((tile + row_start + (x >> 3) * tile_width) & 0x3ff) * 32;
+
+            int color;
+            if (colors256) {
+                color = tiles[(offset + (row & 7) * 8 + (x & 7)) & 0x7fff];
+            } else {
+                int pair = tiles[(offset + (row & 7) * 4 + (x & 7) / 2) & 0x7fff];
+                color = (x & 1) ? pair >> 4 : pair & 0xf;
+                if (color) {
+                    color += (attribute2 >> 12) * 16;
+                }
+            }
+
+            if (color) {
+                colors[screen_x] = read16(memory->palette, 0x200 + color * 2);
+                priorities[screen_x] = priority;
+            }
+        }
+    }
+
+    for (int x = 0; x < PPU_WIDTH; x++) {
+        if (priorities[x] != 0xff && RANK(priorities[x], RANK_SPRITE) <= ranks[x]) {
+            ranks[x] = RANK(priorities[x], RANK_SPRITE);
+            pixels[x] = colors[x];
+        }
+    }
+}
+
+void ppu_line(const struct PpuMemory* memory, struct PpuFrame* frame, int line) {
+    const unsigned char* registers = frame->registers[line];
+    unsigned short* pixels = frame->pixels[line];
+    unsigned short display = read16(registers, 0);
+
+    /* a forced blank is white, and only mode 0 is drawn */
+    if ((display & DISPLAY_BLANK) || (display & DISPLAY_MODE) != 0) {
+        for (int x = 0; x < PPU_WIDTH; x++) {
+            pixels[x] = (display & DISPLAY_BLANK) ? 0x7fff : 0;
+        }
+        return;
+    }
+
+    unsigned char ranks[PPU_WIDTH];
+    unsigned short backdrop = read16(memory->palette, 0);
+    for (int x = 0; x < PPU_WIDTH; x++) {
+        pixels[x] = backdrop;
+        ranks[x] = RANK_BACKDROP;
+    }
+
+    for (int bg = 0; bg < 4; bg++) {
+        if (display & (DISPLAY_BG0 << bg)) {
+            draw_background(memory, registers, bg, line, pixels, ranks);
+        }
+    }
+    if (display & DISPLAY_SPRITES) {
+        draw_sprites(memory, display & DISPLAY_SPRITE_1D, line, pixels, ranks);
+    }
+}
+
+/* the thread pool, started the first time more than one thread is asked for
+ * the threads wait for the generation to change, then draw lines until
+ * next_line runs off the bottom, and the last one done wakes ppu_render */
+#define MAX_THREADS 64
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    int threads;
+    unsigned int generation;
+    const struct PpuMemory* memory;
+    struct PpuFrame* frame;
+    int next_line;
+    int working;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* draw lines until there are none left */
+static void pool_draw() {
+    for (;;) {
+        int line = __atomic_fetch_add(&pool.next_line, 1, __ATOMIC_RELAXED);
+        if (line >= PPU_HEIGHT) {
+            return;
+        }
+        ppu_line(pool.memory, pool.frame, line);
+    }
+}
+
+static void* pool_thread(void* unused) {
+    unsigned int generation = 0;
+    (void) unused;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.generation == generation) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        generation = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        pool_draw();
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.working == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    return NULL;
+}
+
+void ppu_render(const struct PpuMemory* memory, struct PpuFrame* frame, int threads) {
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+    if (threads <= 1) {
+        for (int line = 0; line < PPU_HEIGHT; line++) {
+            ppu_line(memory, frame, line);
+        }
+        return;
+    }
+
+    /* this thread draws too, so it takes one fewer in the pool */
+    pthread_mutex_lock(&pool.lock);
+    while (pool.threads < threads - 1) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_thread, NULL) != 0) {
+            break;
+        }
+        pthread_detach(thread);
+        pool.threads++;
+    }
+    pool.memory = memory;
+    pool.frame = frame;
+    pool.next_line = 0;
+    pool.working = pool.threads;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    pool_draw();
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.working > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/* a 15 bit color as 8 bit red, green and blue */
+static void color_rgb(unsigned short color, unsigned char* rgb) {
+    for (int i = 0; i < 3; i++) {
+        int value = (color >> (i * 5)) & 31;
+        rgb[i] = (value << 3) | (value >> 2);
+    }
+}
+
+int ppu_write_ppm(const char* path, const struct PpuFrame* frame) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", PPU_WIDTH, PPU_HEIGHT);
+    for (int y = 0; y < PPU_HEIGHT; y++) {
+        unsigned char rgb[PPU_WIDTH * 3];
+        for (int x = 0; x < PPU_WIDTH; x++) {
+            color_rgb(frame->pixels[y][x], rgb + x * 3);
+        }
+        fwrite(rgb, 1, sizeof(rgb), file);
+    }
+
+    return fclose(file) == 0;
+}
+
+long ppu_compare_ppm(const char* path, const struct PpuFrame* frame) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    int width, height, maximum;
+    if (fscanf(file, "P6 %d %d %d", &width, &height, &maximum) != 3 ||
+            width != PPU_WIDTH || height != PPU_HEIGHT || maximum != 255 || fgetc(file) == EOF) {
+        fclose(file);
+        return -1;
+    }
+
+    long different = 0;
+    for (int y = 0; y < PPU_HEIGHT; y++) {
+        unsigned char expected[PPU_WIDTH * 3];
+        if (fread(expected, 1, sizeof(expected), file) != sizeof(expected)) {
+            fclose(file);
+            return -1;
+        }
+        for (int x = 0; x < PPU_WIDTH; x++) {
+            unsigned char rgb[3];
+            color_rgb(frame->pixels[y][x], rgb);
+            different += memcmp(rgb, expected + x * 3, 3) != 0;
+        }
+    }
+
+    fclose(file);
+    return different;
+}
@@ -0,0 +1,49 @@
+/* ppu.h
+ * draws the screen on a PC from the GBA's VRAM, OAM, palette and display
+ * registers, for checking what the game puts on screen without an emulator
+ * (platform_host.c uses it to write each frame out, see there)
+ *
+ * it covers what the game uses: mode 0 tiled backgrounds in 16 or 256
+ * colors with their scroll, and regular (not affine) sprites in 16 or 256
+ * colors with flips, every size and 1D or 2D mapping - no windows, blending
+ * or mosaic */
+
+#ifndef PPU_H
+#define PPU_H
+
+#define PPU_WIDTH 240
+#define PPU_HEIGHT 160
+
+/* how many bytes of display registers are latched for each line, up to
+ * and including the scroll registers */
+#define PPU_REGISTERS 0x20
+
+/* the memory to draw from, each the start of its GBA region */
+struct PpuMemory {
+    const unsigned char* palette;
+    const unsigned char* vram;
+    const unsigned char* oam;
+};
+
+/* a frame: the display registers as they were at the start of each line,
+ * since the game can change them while the screen is drawn, and the
+ * pixels that come out, in the GBA's 15 bit BGR */
+struct PpuFrame {
+    unsigned char registers[PPU_HEIGHT][PPU_REGISTERS];
+    unsigned short pixels[PPU_HEIGHT][PPU_WIDTH];
+};
+
+/* draw one line of a frame */
+void ppu_line(const struct PpuMemory* memory, struct PpuFrame* frame, int line);
+
+/* draw every line, with this many threads sharing out the lines */
+void ppu_render(const struct PpuMemory* memory, struct PpuFrame* frame, int threads);
+
+/* write a frame as a binary PPM, returns 0 if it can't */
+int ppu_write_ppm(const char* path, const struct PpuFrame* frame);
+
+/* compare a frame with a PPM written earlier, returning how many pixels
+ * differ, or -1 if it can't be read */
+long ppu_compare_ppm(const char* path, const struct PpuFrame* frame);
+
+#endif
@@ -0,0 +1,35 @@
+/* replay.h
+ * the layout of the input recordings the game makes as it's played, which
+ * it can then play back exactly, on the GBA from ROM (see tools/replay2h.c)
+ * or in the host builds (see platform_host.c)
+ *
+ * the game only depends on the buttons held on each step and the seed it
+ * starts the enemies' random numbers from, so a recording is the seed and
+ * then the value of the button register for each step, run length encoded
+ * as how many steps in a row it stayed the same
+ *
+ * the GBA records into the cartridge's SRAM, which can only be written a
+ * byte at a time, so every field is stored as little endian bytes - what's
+ * saved there is the recording, header and all */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#define REPLAY_MAGIC "GBAREP1\n"
+#define REPLAY_MAGIC_BYTES 8
+
+/* after the magic: the seed, then how many runs follow, 4 bytes each */
+#define REPLAY_SEED 8
+#define REPLAY_RUNS 12
+#define REPLAY_HEADER_BYTES 16
+
+/* each run is the button register, then how many steps it was held for,
+ * 2 bytes each - longer runs are split in two */
+#define REPLAY_RUN_BYTES 4
+#define REPLAY_RUN_STEPS 0xffff
+
+/* the GBA cartridge's SRAM, where recordings are made */
+#define REPLAY_SRAM_BYTES 0x8000
+#define REPLAY_MAX_RUNS ((REPLAY_SRAM_BYTES - REPLAY_HEADER_BYTES) / REPLAY_RUN_BYTES)
+
+#endif
@@ -0,0 +1,178 @@
+/* rng.h
+ * random numbers a buffer at a time, from either of two generators:
+ * xorshift32, the one in xorshift.s, which the game's recordings depend on
+ * so it has to stay as it is, or PCG32, which passes the statistical tests
+ * xorshift32 fails and has 2^63 separate streams to choose from
+ *
+ * calling xorshift for each number costs a call and a load and store of
+ * the seed every time - xorshift_fill keeps the seed in a register and makes
+ * 4 at a time, and on a PC with AVX2 pcg32_fill works out 8 numbers of the
+ * same stream at once in vector registers, so both give exactly what
+ * calling them one at a time would
+ *
+ * rng_range turns them into numbers in [0, range) without the bias of %,
+ * the same way random_range in fastdiv.h does
+ *
+ * the game draws the enemies' rows from xorshift32 this way, which gives
+ * the very numbers it drew from xorshift before, so recordings still play */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include "sections.h"
+
+/* which generator a struct Rng draws from */
+#define RNG_XORSHIFT32 0
+#define RNG_PCG32 1
+
+/* how many numbers are made at a time */
+#define RNG_BUFFER 32
+
+/* the multiplier of PCG32's 64 bit LCG */
+#define PCG32_MULTIPLIER 6364136223846793005ull
+
+struct Pcg32 {
+    unsigned long long state;
+    unsigned long long increment;   /* picks the stream, always odd */
+};
+
+struct Rng {
+    int kind;
+    unsigned int xorshift;          /* the seed, as xorshift.s keeps it */
+    struct Pcg32 pcg;
+    unsigned int values[RNG_BUFFER];
+    int next;                       /* the next of values to hand out */
+};
+
+/* count numbers from xorshift.s's sequence, as calling xorshift count
+ * times would, leaving seed where they would */
+FAR_CALL void xorshift_fill(unsigned int* seed, unsigned int* values, int count);
+
+/* the next number from a PCG32 stream, the XSH RR output of the old state */
+static inline unsigned int pcg32_next(struct Pcg32* pcg) {
+    unsigned long long old = pcg->state;
+    pcg->state = old * PCG32_MULTIPLIER + pcg->increment;
+
+    unsigned int shifted = ((old >> 18) ^ old) >> 27;
+    unsigned int rotation = old >> 59;
+    return (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+}
+
+/* start a PCG32 stream, as its authors' pcg32_srandom does */
+static inline void pcg32_seed(struct Pcg32* pcg, unsigned long long seed, unsigned long long stream) {
+    pcg->state = 0;
+    pcg->increment = (stream << 1) | 1;
+    pcg32_next(pcg);
+    pcg->state += seed;
+    pcg32_next(pcg);
+}
+
+#ifdef __AVX2__
+typedef unsigned long long Pcg32States __attribute__((vector_size(32)));
+typedef unsigned int Pcg32Values __attribute__((vector_size(16)));
+
+/* pcg32_next's output for 4 states at once */
+static inline void pcg32_output(Pcg32States states, unsigned int* values) {
+    Pcg32Values shifted = __builtin_convertvector(((states >> 18) ^ states) >> 27, Pcg32Values);
+    Pcg32Values rotation = __builtin_convertvector(states >> 59, Pcg32Values);
+    Pcg32Values out = (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+    __builtin_memcpy(values, &out, sizeof(out));
+}
+#endif
+
+/* count numbers from a PCG32 stream
+ * the LCG can jump ahead any number of steps with one multiply and add, so
+ * on a PC 8 lanes each start a step further on than the last and then all
+ * jump 8 at a time, as two vectors so one's multiply overlaps the other's
+ * - without AVX2's per lane shifts this is slower than one at a time, so
+ *   elsewhere, the GBA included, they're just made one after the other */
+static inline void pcg32_fill(struct Pcg32* pcg, unsigned int* values, int count) {
+    int i = 0;
+
+#ifdef __AVX2__
+    if (count >= 8) {
+        /* the powers of the multiplier, and the sums of them which the
+         * increment is multiplied by, all worked out by the compiler */
+        const unsigned long long a1 = PCG32_MULTIPLIER, a2 = a1 * a1, a3 = a2 * a1, a4 = a3 * a1;
+        const unsigned long long sum4 = 1 + a1 + a2 + a3, sum8 = sum4 + a4 * sum4;
+        const Pcg32States powers = {1, a1, a2, a3}, sums = {0, 1, 1 + a1, 1 + a1 + a2};
+
+        Pcg32States first = pcg->state * powers + pcg->increment * sums;
+        Pcg32States second = first * a4 + pcg->increment * sum4;
+        const unsigned long long add = pcg->increment * sum8;
+
+        for (; i + 8 <= count; i += 8) {
+            pcg32_output(first, values + i);
+            pcg32_output(second, values + i + 4);
+            first = first * (a4 * a4) + add;
+            second = second * (a4 * a4) + add;
+        }
+        pcg->state = first[0];
+    }
+#endif
+
+    for (; i < count; i++) {
+        values[i] = pcg32_next(pcg);
+    }
+}
+
+static inline void rng_refill(struct Rng* rng) {
+    if (rng->kind == RNG_PCG32) {
+        pcg32_fill(&rng->pcg, rng->values, RNG_BUFFER);
+    } else {
+        xorshift_fill(&rng->xorshift, rng->values, RNG_BUFFER);
+    }
+    rng->next = 0;
+}
+
+/* start drawing xorshift.s's sequence from a seed - the buffer runs ahead
+ * of the numbers handed out, so rng->xorshift isn't the seed a caller of
+ * xorshift would have, but the numbers are the same, and rng_last is */
+static inline void rng_seed_xorshift32(struct Rng* rng, unsigned int seed) {
+    rng->kind = RNG_XORSHIFT32;
+    rng->xorshift = seed;
+    rng->values[RNG_BUFFER - 1] = seed;
+    rng->next = RNG_BUFFER;
+}
+
+static inline void rng_seed_pcg32(struct Rng* rng, unsigned long long seed, unsigned long long stream) {
+    rng->kind = RNG_PCG32;
+    pcg32_seed(&rng->pcg, seed, stream);
+    rng->next = RNG_BUFFER;
+}
+
+static inline unsigned int rng_next(struct Rng* rng) {
+    if (rng->next == RNG_BUFFER) {
+        rng_refill(rng);
+    }
+    return rng->values[rng->next++];
+}
+
+/* the number last handed out - for xorshift32 that's the seed a caller of
+ * xorshift would have now, even before the first number */
+static inline unsigned int rng_last(const struct Rng* rng) {
+    return rng->values[rng->next - 1];
+}
+
+/* a number in [0, range), taking the top of the number times range and
+ * drawing again in the rare case it lands in the uneven part (Lemire's
+ * method, as random_range) - range mustn't be 0 */
+static inline unsigned int rng_range(struct Rng* rng, unsigned int range) {
+    unsigned int threshold = (0u - range) % range;
+    unsigned long long product;
+
+    do {
+        product = (unsigned long long) rng_next(rng) * range;
+    } while ((unsigned int) product < threshold);
+
+    return (unsigned int) (product >> 32);
+}
+
+/* fill values with numbers in [0, range) */
+static inline void rng_fill_range(struct Rng* rng, unsigned int* values, int count, unsigned int range) {
+    for (int i = 0; i < count; i++) {
+        values[i] = rng_range(rng, range);
+    }
+}
+
+#endif
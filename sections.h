@@ -0,0 +1,46 @@
+/* sections.h
+ * attributes for placing code and data in the GBA's faster memories
+ *
+ * code in the cartridge ROM is read 16 bits at a time through wait states,
+ * so it runs as Thumb - the 32K of IWRAM inside the CPU is 32 bits wide with
+ * no wait states, so code which runs every frame goes there as ARM code,
+ * which does more per instruction - see gba.ld and crt0.s for how these
+ * sections get copied out of ROM at startup */
+
+#ifndef SECTIONS_H
+#define SECTIONS_H
+
+#ifdef __arm__
+
+/* a function which lives in IWRAM and is compiled as ARM code
+ * it's too far away from ROM for a normal branch, hence long_call
+ * IWRAM code only calls other IWRAM code, static inline helpers, or ROM
+ * functions marked FAR_CALL - a plain call into ROM still links, through a
+ * veneer the linker adds, but that's a Thumb detour on every call */
+#define IWRAM_CODE __attribute__((section(".iwram"), long_call, target("arm")))
+
+/* a function called across the gap between ROM and IWRAM, either way, so
+ * the call goes through a register - for assembly functions put in IWRAM,
+ * and ROM functions which IWRAM code calls */
+#define FAR_CALL __attribute__((long_call))
+
+/* initialized data which lives in IWRAM or the slower 256K of EWRAM
+ * (zero initialized globals are already in IWRAM, as .bss) */
+#define IWRAM_DATA __attribute__((section(".iwram.data")))
+#define EWRAM_DATA __attribute__((section(".ewram")))
+
+/* zero initialized data which is too big for IWRAM */
+#define EWRAM_BSS __attribute__((section(".ewram_bss")))
+
+#else
+
+/* other machines only have the one kind of memory */
+#define IWRAM_CODE
+#define FAR_CALL
+#define IWRAM_DATA
+#define EWRAM_DATA
+#define EWRAM_BSS
+
+#endif
+
+#endif
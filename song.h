@@ -0,0 +1,43 @@
+/* song.h
+ * the layout of the songs made by tools/mod2gba.c from ProTracker modules
+ *
+ * a song is a list of patterns to play in order, each pattern is 64 rows,
+ * and each row says which note and instrument each of the 4 channels starts,
+ * plus an effect - the instruments are short samples, so a song takes a few
+ * K of patterns and samples rather than hundreds of K of recorded music */
+
+#ifndef SONG_H
+#define SONG_H
+
+#define SONG_CHANNELS 4
+#define SONG_ROWS 64
+
+/* each cell of a pattern is 4 bytes: note, instrument, effect, parameter
+ * notes are 1 (C-1) to 36 (B-3), instruments start at 1, and 0 means none */
+#define SONG_CELL_BYTES 4
+#define SONG_PATTERN_BYTES (SONG_ROWS * SONG_CHANNELS * SONG_CELL_BYTES)
+
+/* the effects the player understands, the rest are ignored */
+#define SONG_EFFECT_JUMP 0xB
+#define SONG_EFFECT_VOLUME 0xC
+#define SONG_EFFECT_BREAK 0xD
+#define SONG_EFFECT_SPEED 0xF
+
+struct SongInstrument {
+    unsigned int offset;        /* where its samples start in the song's data */
+    unsigned int length;        /* in samples, up to the end of the loop */
+    unsigned int loop_length;   /* 0 if it doesn't loop */
+    unsigned char volume;       /* 0 to 64 */
+};
+
+struct Song {
+    const signed char* data;
+    const struct SongInstrument* instruments;
+    const unsigned char* orders;    /* which pattern to play at each position */
+    const unsigned char* patterns;
+    unsigned char order_count;
+    unsigned char speed;            /* ticks per row */
+    unsigned char tempo;            /* 125 is 50 ticks a second */
+};
+
+#endif
@@ -0,0 +1,957 @@
+/* bench.c
+ * times the game's per frame work on a PC, through the host platform layer
+ * (see platform_host.c), and checks the sprite allocator never hands out a
+ * sprite twice, the music stream loops cleanly several times over, the map
+ * streamer keeps the screen block right, the parallax scroll table is
+ * filled in right, FIFO A gets the mixed samples in order and the song
+ * player plays song_test.mod's notes, volumes and tempo as written
+ *
+ * each result is a line of: name, parameter, ns per frame (or per call) and
+ * estimated ARM7 cycles, separated by tabs - the cycles are the host time
+ * scaled by how much slower xorshift.s runs on the GBA than its C version
+ * does here, so they're only a rough guide - results where that means
+ * nothing, like dividing, which the GBA does in software and the PC in
+ * hardware, have - for the cycles
+ *
+ * build: cc -O2 -DPLATFORM_HOST -no-pie -pthread -o bench tools/bench.c platform_host.c ppu.c
+ *
+ * usage: bench [-f frames] [-b baseline.tsv] [-t percent] > results.tsv
+ *   -f  frames to time for each game result (default 2000)
+ *   -b  compare against an earlier run, and fail if anything got slower
+ *   -t  how much slower counts as slower (default 10%) */
+
+#define DEFENDER_NO_MAIN
+#include "../main.c"
+#include "../music.h"
+#include "../song_test.h"
+
+#include <string.h>
+#include <time.h>
+
+/* xorshift.s takes this many cycles on the GBA including the call: bl 3,
+ * ldr 3, the 6 ALU ops 1 each, str 2 and bx 3, all from IWRAM */
+#define XORSHIFT_CYCLES 17
+
+/* each result is the fastest of this many runs, to leave out noise */
+#define RUNS 5
+
+double cycles_per_ns;
+
+/* results go here so the loops making them aren't optimized away */
+volatile int sink;
+
+double now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+/* how long xorshift takes here, to scale host times into GBA cycles */
+void calibrate() {
+    /* through a volatile pointer, so it really is called every time */
+    void (*volatile call)(unsigned int*) = xorshift;
+    unsigned int seed = 1;
+    double best = 1e30;
+
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        for (int i = 0; i < 10000000; i++) {
+            call(&seed);
+        }
+        double ns = (now_ns() - start) / 10000000;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    cycles_per_ns = XORSHIFT_CYCLES / best;
+}
+
+/* the results from the baseline file, if there is one */
+#define MAX_RESULTS 64
+
+struct Result {
+    char name[32];
+    int parameter;
+    double ns;
+};
+
+struct Result baseline[MAX_RESULTS];
+int baseline_count = 0;
+double tolerance = 10;
+int regressions = 0;
+
+void load_baseline(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) && baseline_count < MAX_RESULTS) {
+        struct Result* result = &baseline[baseline_count];
+        if (line[0] != '#' && sscanf(line, "%31s %d %lf", result->name,
+                    &result->parameter, &result->ns) == 3) {
+            baseline_count++;
+        }
+    }
+    fclose(file);
+}
+
+/* compare a result with the baseline */
+void compare(const char* name, int parameter, double ns) {
+    for (int i = 0; i < baseline_count; i++) {
+        if (strcmp(baseline[i].name, name) == 0 && baseline[i].parameter == parameter) {
+            double change = 100 * (ns - baseline[i].ns) / baseline[i].ns;
+            int slower = change > tolerance;
+            fprintf(stderr, "%-16s %4d  %10.1f -> %10.1f ns  %+6.1f%%%s\n", name, parameter,
+                    baseline[i].ns, ns, change, slower ? "  SLOWER" : "");
+            regressions += slower;
+        }
+    }
+}
+
+/* print a result, comparing it with the baseline */
+void report(const char* name, int parameter, double ns) {
+    printf("%s\t%d\t%.1f\t%.0f\n", name, parameter, ns, ns * cycles_per_ns);
+    fflush(stdout);
+    compare(name, parameter, ns);
+}
+
+/* print a result with no cycle estimate, for when the PC's time says
+ * nothing about the GBA's */
+void report_host(const char* name, int parameter, double ns) {
+    printf("%s\t%d\t%.1f\t-\n", name, parameter, ns);
+    fflush(stdout);
+    compare(name, parameter, ns);
+}
+
+/* the buttons held down on each frame: a loop of moving around the screen
+ * and scrolling off both sides of it */
+unsigned short scripted_buttons(int frame) {
+    frame %= 240;
+    if (frame < 70) {
+        return BUTTON_RIGHT;
+    } else if (frame < 100) {
+        return BUTTON_UP;
+    } else if (frame < 170) {
+        return BUTTON_LEFT;
+    } else if (frame < 200) {
+        return BUTTON_DOWN | BUTTON_RIGHT;
+    }
+    return 0;
+}
+
+/* fill the game with count enemies on random rows */
+void add_enemies(int count, unsigned int* seed) {
+    while (enemies.count < count) {
+        int row = random_range(seed, ENEMY_ROWS);
+        if (!enemy_spawn(random_range(seed, SCREEN_WIDTH), row * 8)) {
+            break;
+        }
+    }
+}
+
+/* a whole frame of the game, from reading the buttons to updating OAM, with
+ * count enemies - collisions don't end the game and no more spawn */
+void bench_frames(int count, int frames) {
+    double best = 1e30;
+
+    for (int run = 0; run < RUNS; run++) {
+        struct Game game;
+        unsigned int seed = 12345;
+        game_init(&game, 0);
+        add_enemies(count, &seed);
+        game.next_spawn = 0xffffffff;
+
+        double start = now_ns();
+        for (int frame = 0; frame < frames; frame++) {
+            platform_set_buttons(scripted_buttons(frame));
+            game_update(&game);
+            game.vblank_counter++;
+            game_draw(&game);
+        }
+        double ns = (now_ns() - start) / frames;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    platform_set_buttons(0);
+
+    report("frame", enemies.count, best);
+}
+
+/* hand out every sprite, check the next is refused, give some back, check
+ * those and only those come out again and that freeing twice is refused,
+ * then time taking and giving back a sprite */
+void bench_sprites() {
+    static struct Sprite* taken[NUM_SPRITES];
+
+    enemy_clear();
+    sprite_clear();
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        taken[i] = sprite_init(0, 0, SIZE_16_8, 0, 0, 0, 0);
+        for (int j = 0; j < i; j++) {
+            if (taken[i] == NULL || taken[i] == taken[j]) {
+                fprintf(stderr, "sprites: sprite %d wasn't a new one\n", i);
+                exit(1);
+            }
+        }
+    }
+    if (sprite_init(0, 0, SIZE_16_8, 0, 0, 0, 0) != NULL) {
+        fprintf(stderr, "sprites: got a sprite with all %d in use\n", NUM_SPRITES);
+        exit(1);
+    }
+
+    /* every third one goes back, and can't go back twice */
+    for (int i = 0; i < NUM_SPRITES; i += 3) {
+        if (!sprite_free(taken[i]) || sprite_free(taken[i])) {
+            fprintf(stderr, "sprites: freeing sprite %d twice wasn't refused\n", i);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < NUM_SPRITES; i += 3) {
+        struct Sprite* sprite = sprite_init(0, 0, SIZE_16_8, 0, 0, 0, 0);
+        int found = 0;
+        for (int j = 0; j < NUM_SPRITES; j += 3) {
+            found |= sprite == taken[j];
+        }
+        if (!found) {
+            fprintf(stderr, "sprites: a freed sprite wasn't the one reused\n");
+            exit(1);
+        }
+    }
+    if (sprite_init(0, 0, SIZE_16_8, 0, 0, 0, 0) != NULL) {
+        fprintf(stderr, "sprites: got more sprites back than were freed\n");
+        exit(1);
+    }
+
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        for (int i = 0; i < 100000; i++) {
+            sprite_free(taken[i & 63]);
+            taken[i & 63] = sprite_init(i & 0xff, i & 0x7f, SIZE_16_8, 0, 0, 4, 0);
+        }
+        double ns = (now_ns() - start) / 100000;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    sprite_clear();
+    report("sprite_free_init", 1, best);
+}
+
+/* checking every enemy, the way collisions were found before the rows */
+int enemy_find_linear(int x, int y, int reach_x, int reach_y) {
+    for (int i = 0; i < enemies.count; i++) {
+        if (abs((enemies.x[i] >> 8) - x) <= reach_x && abs(enemies.y[i] - y) <= reach_y) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* one collision check for the player, with the row lists and without */
+void bench_collision(int count) {
+    #define QUERIES 100000
+    static int qx[QUERIES], qy[QUERIES];
+    unsigned int seed = 999;
+
+    enemy_clear();
+    sprite_clear();
+    add_enemies(count, &seed);
+    for (int i = 0; i < QUERIES; i++) {
+        qx[i] = random_range(&seed, SCREEN_WIDTH);
+        qy[i] = random_range(&seed, SCREEN_HEIGHT * 3 / 4);
+    }
+
+    /* the two have to agree on whether there was a hit */
+    for (int i = 0; i < QUERIES; i++) {
+        if ((enemy_find_near(qx[i], qy[i], 16, 8, -1) < 0) !=
+                (enemy_find_linear(qx[i], qy[i], 16, 8) < 0)) {
+            fprintf(stderr, "collision: row lists and linear search disagree at (%d, %d)\n",
+                    qx[i], qy[i]);
+            exit(1);
+        }
+    }
+
+    double rows = 1e30, linear = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        for (int i = 0; i < QUERIES; i++) {
+            sink = enemy_find_near(qx[i], qy[i], 16, 8, -1);
+        }
+        double middle = now_ns();
+        for (int i = 0; i < QUERIES; i++) {
+            sink = enemy_find_linear(qx[i], qy[i], 16, 8);
+        }
+        double end = now_ns();
+
+        if ((middle - start) / QUERIES < rows) {
+            rows = (middle - start) / QUERIES;
+        }
+        if ((end - middle) / QUERIES < linear) {
+            linear = (end - middle) / QUERIES;
+        }
+    }
+    report("collide_rows", enemies.count, rows);
+    report("collide_linear", enemies.count, linear);
+}
+
+/* enemy_update_all as it was before fastdiv.h, drawing each respawned
+ * enemy's row as abs(seed) % ENEMY_ROWS */
+void enemy_update_all_mod(int step, unsigned int* seed) {
+    for (int i = 0; i < enemies.count; i++) {
+        int x = enemies.x[i] + step;
+
+        if ((x >> 8) >= SCREEN_WIDTH) {
+            xorshift(seed);
+            enemy_row_remove(i);
+            enemies.y[i] = (abs((int) *seed) % ENEMY_ROWS) * 8;
+            enemy_row_insert(i);
+            x = 0;
+        }
+        enemies.x[i] = x;
+
+        sprite_position(&sprites[enemies.sprite[i]], x >> 8, enemies.y[i]);
+    }
+}
+
+/* check fast_div and fast_mod against the real thing, then time the call
+ * site the divide was taken out of: every enemy respawning at once, with
+ * the rows drawn the old way and through rng_range
+ *
+ * these are host times only - the PC divides in hardware, and gcc turns a
+ * % by a constant into a multiply here, while the GBA's Thumb code has no
+ * long multiply and calls the divide routine, so the PC can't say what the
+ * old way cost there and no cycles are printed */
+void bench_divide() {
+    #define DIVIDES 1000000
+    volatile unsigned int divisor = CYCLES_PER_BLANK;
+
+    for (unsigned int n = 0; n < DIVIDES; n++) {
+        unsigned int value = n * 4297u;
+        if (FAST_DIV(value, CYCLES_PER_BLANK) != value / divisor ||
+                FAST_MOD(value, CYCLES_PER_BLANK) != value % divisor) {
+            fprintf(stderr, "divide: fast_div or fast_mod is wrong for %u\n", value);
+            exit(1);
+        }
+    }
+
+    unsigned int seed = 12345;
+    enemy_clear();
+    sprite_clear();
+    add_enemies(MAX_ENEMIES, &seed);
+
+    double old = 1e30, new = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        struct Rng rng;
+        rng_seed_xorshift32(&rng, 12345);
+
+        /* every enemy goes off the right side on every call */
+        double start = now_ns();
+        for (int frame = 0; frame < 2000; frame++) {
+            enemy_update_all_mod(SCREEN_WIDTH << 8, &seed);
+        }
+        double middle = now_ns();
+        for (int frame = 0; frame < 2000; frame++) {
+            enemy_update_all(SCREEN_WIDTH << 8, &rng);
+        }
+        double end = now_ns();
+
+        if ((middle - start) / 2000 < old) {
+            old = (middle - start) / 2000;
+        }
+        if ((end - middle) / 2000 < new) {
+            new = (end - middle) / 2000;
+        }
+    }
+
+    report_host("respawn_mod", enemies.count, old);
+    report_host("respawn_range", enemies.count, new);
+}
+
+/* random numbers one call at a time against a buffer at a time, after
+ * checking the buffered ones come out the same */
+void bench_random() {
+    #define NUMBERS 1000000
+    static unsigned int values[RNG_BUFFER];
+    unsigned int total = 0;
+
+    /* every length, to catch the ends of the unrolled loops */
+    for (int count = 0; count <= RNG_BUFFER; count++) {
+        unsigned int one = 12345, fill = 12345;
+        xorshift_fill(&fill, values, count);
+        for (int i = 0; i < count; i++) {
+            xorshift(&one);
+            if (values[i] != one) {
+                fprintf(stderr, "random: xorshift_fill of %d differs at %d\n", count, i);
+                exit(1);
+            }
+        }
+        if (fill != one) {
+            fprintf(stderr, "random: xorshift_fill of %d leaves the wrong seed\n", count);
+            exit(1);
+        }
+
+        struct Pcg32 a, b;
+        pcg32_seed(&a, 42, 54);
+        b = a;
+        pcg32_fill(&a, values, count);
+        for (int i = 0; i < count; i++) {
+            if (values[i] != pcg32_next(&b)) {
+                fprintf(stderr, "random: pcg32_fill of %d differs at %d\n", count, i);
+                exit(1);
+            }
+        }
+        if (a.state != b.state) {
+            fprintf(stderr, "random: pcg32_fill of %d leaves the wrong state\n", count);
+            exit(1);
+        }
+    }
+
+    /* the start of the PCG authors' pcg32-demo, seed 42 on stream 54 */
+    static const unsigned int expected[] = {0xa15c02b7, 0x7b47f409, 0xba1d3330, 0x83d2f293};
+    struct Pcg32 pcg;
+    pcg32_seed(&pcg, 42, 54);
+    for (int i = 0; i < 4; i++) {
+        if (pcg32_next(&pcg) != expected[i]) {
+            fprintf(stderr, "random: pcg32 isn't PCG32\n");
+            exit(1);
+        }
+    }
+
+    double call = 1e30, fill = 1e30, next = 1e30, pcg_fill = 1e30, range = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        unsigned int seed = 12345;
+        struct Rng rng;
+
+        double start = now_ns();
+        for (int n = 0; n < NUMBERS; n++) {
+            xorshift(&seed);
+            total += seed;
+        }
+        double time = (now_ns() - start) / NUMBERS;
+        call = time < call ? time : call;
+
+        start = now_ns();
+        for (int n = 0; n < NUMBERS; n += RNG_BUFFER) {
+            xorshift_fill(&seed, values, RNG_BUFFER);
+            total += values[n & (RNG_BUFFER - 1)];
+        }
+        time = (now_ns() - start) / NUMBERS;
+        fill = time < fill ? time : fill;
+
+        start = now_ns();
+        for (int n = 0; n < NUMBERS; n++) {
+            total += pcg32_next(&pcg);
+        }
+        time = (now_ns() - start) / NUMBERS;
+        next = time < next ? time : next;
+
+        start = now_ns();
+        for (int n = 0; n < NUMBERS; n += RNG_BUFFER) {
+            pcg32_fill(&pcg, values, RNG_BUFFER);
+            total += values[n & (RNG_BUFFER - 1)];
+        }
+        time = (now_ns() - start) / NUMBERS;
+        pcg_fill = time < pcg_fill ? time : pcg_fill;
+
+        rng_seed_pcg32(&rng, run, 0);
+        start = now_ns();
+        for (int n = 0; n < NUMBERS; n++) {
+            total += rng_range(&rng, ENEMY_ROWS);
+        }
+        time = (now_ns() - start) / NUMBERS;
+        range = time < range ? time : range;
+    }
+
+    sink = total;
+    report("xorshift_call", 1, call);
+    report("xorshift_fill", RNG_BUFFER, fill);
+    report("pcg32_next", 1, next);
+    report("pcg32_fill", RNG_BUFFER, pcg_fill);
+    report("rng_range", ENEMY_ROWS, range);
+}
+
+/* scroll a map much wider than the screen block back and forth, jumps and
+ * all, checking the screen block always ends up holding the right 32
+ * columns, then time the vblank's work when the scroll crosses a tile */
+void bench_map_stream() {
+    #define WIDE_MAP 100
+    static unsigned short map[WIDE_MAP * 32];
+    struct MapStream stream;
+    unsigned int seed = 12345;
+
+    /* every tile different, so a column in the wrong place shows */
+    for (int i = 0; i < WIDE_MAP * 32; i++) {
+        map[i] = i;
+    }
+
+    /* screen block 30 is free, past the background image and the maps */
+    int scroll = -300;
+    map_stream_init(&stream, map, WIDE_MAP, 0, 32, 30, scroll);
+    for (int step = 0; step < 100000; step++) {
+        if (step % 1000 == 999) {
+            scroll += random_range(&seed, 2001) - 1000;
+        } else {
+            scroll += random_range(&seed, 5) - 2;
+        }
+        map_stream_scroll(&stream, scroll);
+
+        /* a jump takes a few frames to catch up with */
+        int frames = 1;
+        while (stream.left != scroll >> 3) {
+            map_stream_scroll(&stream, scroll);
+            frames++;
+        }
+        if (frames > 1 + 1000 / 8 / MAP_STREAM_BUDGET + 1) {
+            fprintf(stderr, "map stream: took %d frames to catch up\n", frames);
+            exit(1);
+        }
+
+        for (int column = stream.left; column < stream.left + 32; column++) {
+            int map_column = ((column % WIDE_MAP) + WIDE_MAP) % WIDE_MAP;
+            for (int row = 0; row < 32; row++) {
+                if (stream.screen[row * 32 + (column & 31)] != map[row * WIDE_MAP + map_column]) {
+                    fprintf(stderr, "map stream: column %d row %d is wrong at scroll %d\n",
+                            column, row, scroll);
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        for (int frame = 0; frame < 2000; frame++) {
+            scroll += 8;
+            map_stream_scroll(&stream, scroll);
+        }
+        double ns = (now_ns() - start) / 2000;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    report("map_stream_column", 32, best);
+}
+
+/* check the scroll table against each band's speed, and that the bands
+ * cover the screen and stream in the right columns, then time filling it */
+void check_parallax(const struct Parallax* layer, const struct ParallaxLine* table, int bg,
+        int xscroll) {
+    int line = 0;
+    for (int i = 0; i < layer->count; i++) {
+        int scroll = (xscroll * layer->bands[i].speed) >> 8;
+        if (layer->streams[i].left != scroll >> 3) {
+            fprintf(stderr, "parallax: bg%d band %d streams column %d at scroll %d\n",
+                    bg, i, layer->streams[i].left, scroll);
+            exit(1);
+        }
+        for (int end = line + layer->bands[i].lines; line < end; line++) {
+            if (table[line].scroll[bg][0] != scroll || table[line].scroll[bg][1]) {
+                fprintf(stderr, "parallax: bg%d line %d is %d, %d at xscroll %d, not %d, 0\n",
+                        bg, line, table[line].scroll[bg][0], table[line].scroll[bg][1],
+                        xscroll, scroll);
+                exit(1);
+            }
+        }
+    }
+    if (line != SCREEN_HEIGHT) {
+        fprintf(stderr, "parallax: bg%d's bands cover %d lines\n", bg, line);
+        exit(1);
+    }
+}
+
+/* a step of scrolling, finishing in the middle of the frame - the table
+ * being shown mustn't change until the next vblank shows the new one */
+void step_parallax(int xscroll) {
+    static struct ParallaxLine shown[SCREEN_HEIGHT + 1];
+    memcpy(shown, parallax_tables[parallax_showing], sizeof(shown));
+
+    *scanline_counter = 80;
+    parallax_update(xscroll);
+    if (parallax_ready == parallax_showing ||
+            memcmp(shown, parallax_tables[parallax_showing], sizeof(shown)) != 0) {
+        fprintf(stderr, "parallax: the table being shown changed at xscroll %d\n", xscroll);
+        exit(1);
+    }
+    check_parallax(&space_parallax, parallax_tables[parallax_ready], 0, xscroll);
+    check_parallax(&landscape_parallax, parallax_tables[parallax_ready], 1, xscroll);
+
+    parallax_vblank();
+    if (*bg0_x_scroll != parallax_tables[parallax_showing][0].scroll[0][0] ||
+            *bg1_x_scroll != parallax_tables[parallax_showing][0].scroll[1][0] ||
+            *dma0_source != GBA_ADDRESS(&parallax_tables[parallax_showing][1])) {
+        fprintf(stderr, "parallax: the vblank didn't start the new table\n");
+        exit(1);
+    }
+}
+
+void bench_parallax() {
+    /* start the backgrounds over from wherever bench_frames left them */
+    setup_background();
+
+    /* back and forth a frame's scroll at a time, well past the wraps */
+    for (int xscroll = 0; xscroll > -3000; xscroll -= 2) {
+        step_parallax(xscroll);
+    }
+    for (int xscroll = -3000; xscroll < 3000; xscroll += 2) {
+        step_parallax(xscroll);
+    }
+
+    /* and one done in the vblank is shown straight away */
+    *scanline_counter = SCREEN_HEIGHT;
+    parallax_update(3000);
+    if (parallax_showing != parallax_ready ||
+            *bg1_x_scroll != parallax_tables[parallax_showing][0].scroll[1][0]) {
+        fprintf(stderr, "parallax: a table filled in the vblank wasn't shown\n");
+        exit(1);
+    }
+
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        for (int frame = 0; frame < 2000; frame++) {
+            parallax_update(3000 + frame * 2);
+        }
+        double ns = (now_ns() - start) / 2000;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    report("parallax_update", SCREEN_HEIGHT, best);
+    printf("# the hblank DMA of the scroll table takes about %d GBA cycles a frame\n",
+            PARALLAX_LINE_CYCLES * SCREEN_HEIGHT);
+}
+
+/* play a known sound through the simulated FIFO A for a number of frames,
+ * and check what comes out is the mixed samples in order, none lost or
+ * repeated, through every swap of the mix buffers - including DMA being
+ * sent back to the start of mix_buffer every other frame while the FIFO
+ * still holds what it read ahead */
+void check_mixer_output() {
+    #define CHECK_FRAMES 20
+    #define RAMP 97
+    static signed char ramp[RAMP];
+    static signed char played[(CHECK_FRAMES + 1) * MIXER_SAMPLES];
+
+    /* never 0, so the silence before it starts can be told apart */
+    for (int i = 0; i < RAMP; i++) {
+        ramp[i] = i + 1;
+    }
+
+    /* on its own at full volume, a voice is mixed into exactly its samples */
+    mixer_init();
+    mixer_play(ramp, RAMP, 1 << MIXER_FRACTION, 0, MIXER_MAX_VOLUME);
+    platform_capture_sound(0, played, sizeof(played));
+
+    /* the vblank handler's part, without the rest of on_vblank */
+    for (int frame = 0; frame < CHECK_FRAMES; frame++) {
+        do {
+            platform_scanlines(1);
+        } while (*scanline_counter != SCREEN_HEIGHT);
+        mixer_vblank();
+    }
+    *timer0_control = 0;
+    *dma1_control = 0;
+    mixer_init();
+    mixer_running = 0;
+
+    /* the first frame plays the buffer cleared by mixer_init, and maybe a
+     * sample of the empty FIFO before DMA first fills it */
+    unsigned int count = platform_captured(0), silence = 0;
+    platform_capture_sound(0, NULL, 0);
+    while (silence < count && played[silence] == 0) {
+        silence++;
+    }
+    if (silence < MIXER_SAMPLES || silence > MIXER_SAMPLES + 1 ||
+            count < (CHECK_FRAMES - 2) * MIXER_SAMPLES) {
+        fprintf(stderr, "mixer: %u samples played, %u of them silent at the start\n",
+                count, silence);
+        exit(1);
+    }
+    for (unsigned int i = silence; i < count; i++) {
+        if (played[i] != ramp[(i - silence) % RAMP]) {
+            fprintf(stderr, "mixer: sample %u of FIFO A is %d, not %d (frame %u)\n",
+                    i, played[i], ramp[(i - silence) % RAMP], i / MIXER_SAMPLES);
+            exit(1);
+        }
+    }
+}
+
+/* mixing a frame of sound with some of the voices playing */
+void bench_mixer(int count) {
+    mixer_init();
+    for (int i = 0; i < count; i++) {
+        mixer_play(music + i * 1000, 50000, MIXER_STEP(MUSIC_SAMPLE_RATE) + i * 100, 0,
+                MIXER_MAX_VOLUME / 2);
+    }
+
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        for (int frame = 0; frame < 2000; frame++) {
+            mixer_mix();
+        }
+        double ns = (now_ns() - start) / 2000;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+
+    for (int i = 0; i < MIXER_VOICES; i++) {
+        mixer_stop(i);
+    }
+    report("mixer", count, best);
+}
+
+/* play the music stream a frame at a time, as the vblank handler does, for
+ * STREAM_LOOPS times through and a bit, and check every sample is within
+ * the ADPCM error of the original recording, right through each point where
+ * it loops - so a loop that drifts or leaves the decoder off shows up */
+#define STREAM_LOOPS 4
+
+void bench_stream_loop() {
+    mixer_init();
+    stream_play(music_adpcm, music_adpcm_samples, MIXER_STEP(MUSIC_SAMPLE_RATE), MIXER_MAX_VOLUME);
+    struct Voice* voice = &voices[stream.voice];
+
+    /* how far the voice has got through the music, rather than the ring */
+    unsigned long long position = 0;
+    unsigned long long end = (unsigned long long) (STREAM_LOOPS * music_bytes + music_bytes / 4) << MIXER_FRACTION;
+    double ns = 0;
+    int frames = 0;
+
+    while (position < end) {
+        double start = now_ns();
+        stream_fill();
+        ns += now_ns() - start;
+        frames++;
+
+        /* the samples the mixer would play this frame */
+        for (int i = 0; i < MIXER_SAMPLES; i++) {
+            int sample = stream_ring[(position >> MIXER_FRACTION) & (STREAM_RING - 1)];
+            int index = (position >> MIXER_FRACTION) % music_bytes;
+            if (abs(sample - music[index]) > 16) {
+                fprintf(stderr, "stream: sample %d is %d, the recording has %d\n",
+                        index, sample, music[index]);
+                exit(1);
+            }
+            position += voice->step;
+        }
+        voice->position = position & ((STREAM_RING << MIXER_FRACTION) - 1);
+    }
+
+    mixer_stop(stream.voice);
+    stream.voice = -1;
+    report("stream_fill", MUSIC_SAMPLE_RATE, ns / frames);
+}
+
+/* step the song player through song_test.mod a vblank at a time, as
+ * mixer_vblank does, and check each row it plays against the pattern data:
+ * the notes its voices start, their volumes, the speed and tempo, how many
+ * vblanks the row lasts and which row comes next */
+#define SONG_CHECK_ROWS 40
+
+/* a voice position no note starts at, to tell which voices were restarted */
+#define SONG_UNTOUCHED 12345
+
+/* how long a tick of the song lasts at a tempo, in vblanks */
+double song_tick_vblanks(int tempo) {
+    return (double) CLOCK / CYCLES_PER_BLANK / (tempo * 2 / 5.0);
+}
+
+void check_song() {
+    const struct Song* song = &song_test;
+    mixer_init();
+    if (!song_play(song, MIXER_MAX_VOLUME)) {
+        fprintf(stderr, "song: no voices for the song\n");
+        exit(1);
+    }
+
+    /* where the song should be, and what its rows have set up so far */
+    int order = 0, row = 0, speed = song->speed, tempo = song->tempo, vblanks = 0;
+    int volume[SONG_CHANNELS] = {0};
+    const struct SongInstrument* instrument[SONG_CHANNELS] = {0};
+    for (int i = 0; i < SONG_CHANNELS; i++) {
+        voices[song_player.channels[i].voice].position = SONG_UNTOUCHED;
+    }
+
+    for (int rows = 0; rows < SONG_CHECK_ROWS; ) {
+        song_vblank();
+        vblanks++;
+        if (song_player.order == order && song_player.row == row) {
+            continue;
+        }
+
+        /* the row is over, so everything it does has been done */
+        const unsigned char* cell = song->patterns + song->orders[order] * SONG_PATTERN_BYTES
+            + row * SONG_CHANNELS * SONG_CELL_BYTES;
+        int row_tempo = tempo, next_order = -1, next_row = 0;
+        for (int i = 0; i < SONG_CHANNELS; i++, cell += SONG_CELL_BYTES) {
+            struct Voice* voice = &voices[song_player.channels[i].voice];
+            int note = cell[0], effect = cell[2], parameter = cell[3];
+
+            if (cell[1]) {
+                instrument[i] = &song->instruments[cell[1] - 1];
+                volume[i] = instrument[i]->volume;
+            }
+            if (effect == SONG_EFFECT_VOLUME) {
+                volume[i] = parameter > 64 ? 64 : parameter;
+            } else if (effect == SONG_EFFECT_SPEED && parameter >= 32) {
+                tempo = parameter;
+            } else if (effect == SONG_EFFECT_SPEED && parameter > 0) {
+                speed = parameter;
+            } else if (effect == SONG_EFFECT_JUMP) {
+                next_order = parameter;
+            } else if (effect == SONG_EFFECT_BREAK) {
+                if (next_order < 0) {
+                    next_order = order + 1;
+                }
+                next_row = (parameter >> 4) * 10 + (parameter & 0xf);
+            }
+
+            /* a note starts its instrument from the beginning, at the pitch
+             * of the note on the Amiga, where C-1 is 4143.6 Hz */
+            if (note && instrument[i]->length) {
+                double hz = 4143.6;
+                for (int n = 1; n < note; n++) {
+                    hz *= 1.0594630943592953;
+                }
+                double step = hz / MIXER_RATE * (1 << MIXER_FRACTION);
+                double off = voice->step > step ? voice->step - step : step - voice->step;
+                if (!voice->active || voice->position != 0 ||
+                        voice->data != song->data + instrument[i]->offset ||
+                        voice->end != instrument[i]->length << MIXER_FRACTION ||
+                        voice->loop != instrument[i]->loop_length << MIXER_FRACTION ||
+                        off > step / 100) {
+                    fprintf(stderr, "song: order %d row %d channel %d didn't start note %d\n",
+                            order, row, i, note);
+                    exit(1);
+                }
+            } else if (note && voice->active) {
+                fprintf(stderr, "song: order %d row %d channel %d played an empty instrument\n",
+                        order, row, i);
+                exit(1);
+            } else if (!note && voice->position != SONG_UNTOUCHED) {
+                fprintf(stderr, "song: order %d row %d channel %d restarted with no note\n",
+                        order, row, i);
+                exit(1);
+            }
+
+            if (instrument[i] && voice->volume != volume[i] * MIXER_MAX_VOLUME >> 6) {
+                fprintf(stderr, "song: order %d row %d channel %d has volume %d, not %d\n",
+                        order, row, i, voice->volume, volume[i] * MIXER_MAX_VOLUME >> 6);
+                exit(1);
+            }
+            voice->position = SONG_UNTOUCHED;
+        }
+
+        /* the row lasts speed ticks, the first of them at the tempo from
+         * before any change the row makes */
+        double expected = song_tick_vblanks(row_tempo) + (speed - 1) * song_tick_vblanks(tempo);
+        if (song_player.speed != speed || song_player.tempo != tempo ||
+                vblanks < expected - 1 || vblanks > expected + 1) {
+            fprintf(stderr, "song: order %d row %d took %d vblanks at speed %d tempo %d, "
+                    "not %.1f at speed %d tempo %d\n", order, row, vblanks, song_player.speed,
+                    song_player.tempo, expected, speed, tempo);
+            exit(1);
+        }
+
+        if (next_order < 0) {
+            next_order = order;
+            next_row = row + 1;
+            if (next_row == SONG_ROWS) {
+                next_order++;
+                next_row = 0;
+            }
+        }
+        if (next_row >= SONG_ROWS) {
+            next_row = 0;
+        }
+        if (next_order >= song->order_count) {
+            next_order = 0;
+        }
+        if (song_player.order != next_order || song_player.row != next_row) {
+            fprintf(stderr, "song: order %d row %d went to order %d row %d, not %d %d\n",
+                    order, row, song_player.order, song_player.row, next_order, next_row);
+            exit(1);
+        }
+        order = next_order;
+        row = next_row;
+        vblanks = 0;
+        rows++;
+
+        /* the game speeding the music up part way through */
+        if (rows == SONG_CHECK_ROWS / 2) {
+            tempo = 160;
+            song_set_tempo(tempo);
+        }
+    }
+
+    song_stop();
+    mixer_init();
+}
+
+int main(int argc, char** argv) {
+    int frames = 2000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            load_baseline(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-f frames] [-b baseline.tsv] [-t percent]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    calibrate();
+    printf("# name\tparameter\tns\tcycles\n");
+    printf("# %.2f GBA cycles per host ns\n", cycles_per_ns);
+
+    /* the hardware the game expects, minus the vblank interrupt, so only the
+     * game's own work is timed */
+    *display_control = MODE0 | BG0_ENABLE | BG1_ENABLE | SPRITE_ENABLE | SPRITE_MAP_1D;
+    setup_background();
+    setup_sprite_image();
+
+    for (int count = 1; count <= NUM_SPRITES; count *= 2) {
+        bench_frames(count, frames);
+    }
+
+    bench_sprites();
+
+    int counts[] = {1, 16, 64, 128};
+    for (int i = 0; i < 4; i++) {
+        bench_collision(counts[i]);
+    }
+
+    bench_divide();
+    bench_random();
+    bench_map_stream();
+    bench_parallax();
+
+    check_mixer_output();
+
+    int voice_counts[] = {1, 4, 8};
+    for (int i = 0; i < 3; i++) {
+        bench_mixer(voice_counts[i]);
+    }
+
+    bench_stream_loop();
+    check_song();
+
+    if (regressions) {
+        fprintf(stderr, "%d results are more than %.0f%% slower than the baseline\n",
+                regressions, tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,320 @@
+/* difficulty.c
+ * plays the game on a PC many times over, with a bot at the controls, to
+ * see how long players last under the spawn curve and how many enemies the
+ * frames have to move - so the curve can be tuned from numbers rather than
+ * by feel (main.c takes SPAWN_INTERVAL and SPAWN_GROWTH from the command
+ * line to try others)
+ *
+ * each game starts from its own seed and runs game_update alone, with no
+ * drawing or sound, until the player is hit or the step limit is reached
+ * the game keeps everything in globals, the simulated hardware included, so
+ * the games are shared out between worker processes rather than threads:
+ * each one takes the next batch of games whenever it finishes one, so the
+ * fast workers pick up the slack of the slow ones, and they only meet to
+ * take a batch and to add up their results at the end
+ *
+ * the output is lines of: what, value, count, separated by tabs
+ *   survival  seconds lasted (in steps of 10)      games
+ *   peak      most enemies at once                 games
+ *   enemies   enemies moved in a frame             frames
+ * the enemies moved is the frame's work, bench prints what that costs
+ *
+ * build: cc -O2 -DPLATFORM_HOST -no-pie -pthread -o difficulty \
+ *            tools/difficulty.c platform_host.c ppu.c
+ *
+ * usage: difficulty [-n games] [-j workers] [-p policy] [-s seed] [-m steps]
+ *   -n  how many games to play (default 100000)
+ *   -j  how many worker processes (default one per core)
+ *   -p  the bot: idle, random or dodge (default dodge)
+ *   -s  the seed the games' seeds are made from (default 1)
+ *   -m  end a game that lasts this many steps (default 36000, 10 minutes) */
+
+#define DEFENDER_NO_MAIN
+#include "../main.c"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 256
+
+/* how many games a worker takes at once */
+#define BATCH 64
+
+/* survival is counted in 10 second buckets, with the last for the rest */
+#define SURVIVAL_BUCKET 600
+#define SURVIVAL_BUCKETS 64
+
+/* a bot: its own random numbers, and the buttons it's holding for a while */
+struct Bot {
+    unsigned int seed;
+    unsigned short held;
+    int left;
+};
+
+/* each policy picks the buttons to press for the next step */
+typedef unsigned short (*Policy)(struct Bot* bot, const struct Game* game);
+
+/* never touches anything */
+unsigned short policy_idle(struct Bot* bot, const struct Game* game) {
+    (void) bot;
+    (void) game;
+    return 0;
+}
+
+/* holds a random direction, or nothing, for a random while */
+unsigned short policy_random(struct Bot* bot, const struct Game* game) {
+    static const unsigned short moves[] = {
+        0, BUTTON_LEFT, BUTTON_RIGHT, BUTTON_UP, BUTTON_DOWN,
+        BUTTON_LEFT | BUTTON_UP, BUTTON_LEFT | BUTTON_DOWN,
+        BUTTON_RIGHT | BUTTON_UP, BUTTON_RIGHT | BUTTON_DOWN
+    };
+    (void) game;
+
+    if (bot->left-- <= 0) {
+        bot->held = moves[random_range(&bot->seed, 9)];
+        bot->left = 8 + random_range(&bot->seed, 56);
+    }
+    return bot->held;
+}
+
+/* whether an enemy is coming at (x, y) from up to a frame's worth of
+ * movement and a bit away - enemies only ever come from the left */
+int threatened(int x, int y) {
+    int reach = 24 + enemies.count + 1;
+    return enemy_find_near(x - reach, y, reach, 10, -1) >= 0;
+}
+
+/* moves up or down out of the way of enemies coming along its row, and
+ * otherwise drifts back toward the middle of the screen */
+unsigned short policy_dodge(struct Bot* bot, const struct Game* game) {
+    int x = game->player.x >> 8, y = game->player.y >> 8;
+    int bottom = SCREEN_HEIGHT * 3 / 4;
+    (void) bot;
+
+    if (threatened(x, y)) {
+        int up = y >= 16 && !threatened(x, y - 16);
+        int down = y + 16 < bottom && !threatened(x, y + 16);
+        if (up && (!down || y > bottom / 2)) {
+            return BUTTON_UP;
+        }
+        if (down) {
+            return BUTTON_DOWN;
+        }
+        /* nowhere safe, so head for whichever side has more room */
+        return y > bottom / 2 ? BUTTON_UP : BUTTON_DOWN;
+    }
+    return 0;
+}
+
+struct {
+    const char* name;
+    Policy policy;
+} policies[] = {
+    {"idle", policy_idle},
+    {"random", policy_random},
+    {"dodge", policy_dodge},
+};
+
+/* what a worker adds up, kept apart from the others until the end */
+struct Results {
+    unsigned long games;
+    unsigned long steps;
+    unsigned long survival[SURVIVAL_BUCKETS];
+    unsigned long peak[MAX_ENEMIES + 1];
+    unsigned long enemies[MAX_ENEMIES + 1];
+};
+
+/* shared between the workers, in memory they all map */
+struct Shared {
+    atomic_ulong next_game;
+    struct Results results[MAX_WORKERS];
+};
+
+/* a game's seed, spread out from the game's number so neighbouring games
+ * don't start alike - never 0, which would have the game pick its own */
+unsigned int game_seed(unsigned int base, unsigned long game) {
+    unsigned long long z = base + game * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (unsigned int) (z ^ (z >> 31)) | 1;
+}
+
+/* play one game to the end, adding it to the results */
+void play(struct Results* results, Policy policy, unsigned int seed, unsigned int max_steps) {
+    struct Game game;
+    struct Bot bot = {seed ^ 0x5bd1e995, 0, 0};
+    int peak = 0;
+    unsigned int steps = 0;
+
+    game_init(&game, 0);
+    game.seed = seed;
+
+    while (!game.done && steps < max_steps) {
+        platform_set_buttons(policy(&bot, &game));
+        game_update(&game);
+        game.vblank_counter++;
+        steps++;
+
+        results->enemies[enemies.count]++;
+        if (enemies.count > peak) {
+            peak = enemies.count;
+        }
+    }
+
+    unsigned int bucket = steps / SURVIVAL_BUCKET;
+    results->survival[bucket < SURVIVAL_BUCKETS ? bucket : SURVIVAL_BUCKETS - 1]++;
+    results->peak[peak]++;
+    results->steps += steps;
+    results->games++;
+}
+
+/* take batches of games until there are none left */
+void work(struct Shared* shared, int worker, Policy policy, unsigned long games,
+        unsigned int base, unsigned int max_steps) {
+    struct Results* results = &shared->results[worker];
+
+    for (;;) {
+        unsigned long first = atomic_fetch_add(&shared->next_game, BATCH);
+        if (first >= games) {
+            return;
+        }
+        unsigned long last = first + BATCH < games ? first + BATCH : games;
+        for (unsigned long game = first; game < last; game++) {
+            play(results, policy, game_seed(base, game), max_steps);
+        }
+    }
+}
+
+/* the step at which a fraction of the games had ended, from the buckets */
+double percentile(const struct Results* total, double fraction) {
+    unsigned long seen = 0;
+    for (int i = 0; i < SURVIVAL_BUCKETS; i++) {
+        seen += total->survival[i];
+        if (seen >= fraction * total->games) {
+            return (i + 1) * SURVIVAL_BUCKET / 60.0;
+        }
+    }
+    return SURVIVAL_BUCKETS * SURVIVAL_BUCKET / 60.0;
+}
+
+int main(int argc, char** argv) {
+    unsigned long games = 100000;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    Policy policy = policy_dodge;
+    const char* policy_name = "dodge";
+    unsigned int base = 1, max_steps = 36000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            games = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            workers = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            base = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            max_steps = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            policy = NULL;
+            policy_name = argv[++i];
+            for (unsigned int j = 0; j < sizeof(policies) / sizeof(policies[0]); j++) {
+                if (strcmp(policies[j].name, policy_name) == 0) {
+                    policy = policies[j].policy;
+                }
+            }
+            if (!policy) {
+                fprintf(stderr, "%s: no policy called %s\n", argv[0], policy_name);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [-n games] [-j workers] [-p idle|random|dodge] "
+                    "[-s seed] [-m steps]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (workers < 1) {
+        workers = 1;
+    } else if (workers > MAX_WORKERS) {
+        workers = MAX_WORKERS;
+    }
+
+    struct Shared* shared = mmap(NULL, sizeof(struct Shared), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    atomic_init(&shared->next_game, 0);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    fflush(stdout);
+    for (long worker = 0; worker < workers; worker++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            work(shared, worker, policy, games, base, max_steps);
+            _exit(0);
+        }
+    }
+
+    int failed = 0, status;
+    while (wait(&status) > 0) {
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    if (failed) {
+        fprintf(stderr, "%s: a worker failed\n", argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    /* add up what the workers found */
+    static struct Results total;
+    for (long worker = 0; worker < workers; worker++) {
+        const struct Results* results = &shared->results[worker];
+        total.games += results->games;
+        total.steps += results->steps;
+        for (int i = 0; i < SURVIVAL_BUCKETS; i++) {
+            total.survival[i] += results->survival[i];
+        }
+        for (int i = 0; i <= MAX_ENEMIES; i++) {
+            total.peak[i] += results->peak[i];
+            total.enemies[i] += results->enemies[i];
+        }
+    }
+
+    printf("# what\tvalue\tcount\n");
+    printf("# policy %s, spawning every %d steps, growing %dx\n",
+            policy_name, SPAWN_INTERVAL, SPAWN_GROWTH);
+    for (int i = 0; i < SURVIVAL_BUCKETS; i++) {
+        if (total.survival[i]) {
+            printf("survival\t%d\t%lu\n", i * SURVIVAL_BUCKET / 60, total.survival[i]);
+        }
+    }
+    for (int i = 0; i <= MAX_ENEMIES; i++) {
+        if (total.peak[i]) {
+            printf("peak\t%d\t%lu\n", i, total.peak[i]);
+        }
+    }
+    for (int i = 0; i <= MAX_ENEMIES; i++) {
+        if (total.enemies[i]) {
+            printf("enemies\t%d\t%lu\n", i, total.enemies[i]);
+        }
+    }
+
+    fprintf(stderr, "%lu games with %ld workers in %.1f s, %.0f games/s, %.0f steps/s\n",
+            total.games, workers, seconds, total.games / seconds, total.steps / seconds);
+    fprintf(stderr, "survived %.1f s on average, half by %.0f s, 90%% by %.0f s, 99%% by %.0f s\n",
+            total.steps / 60.0 / total.games, percentile(&total, 0.5),
+            percentile(&total, 0.9), percentile(&total, 0.99));
+    return 0;
+}
@@ -0,0 +1,585 @@
+/* lockstep.c
+ * plays many games at once on a PC, one to each lane of the vector unit,
+ * for running far more games a second than tools/difficulty.c can when
+ * all that's wanted is how long they last
+ *
+ * it's a copy of game_update's logic, minus the drawing: the enemies are
+ * stored enemy by enemy with a lane for each game, so moving one enemy,
+ * wrapping it, drawing its new row with xorshift and testing it against the
+ * player is done for every game in a handful of vector instructions - a
+ * lane whose game ends starts the next one straight away, and lanes with
+ * fewer enemies than the others sit out the rest of the enemy loop
+ *
+ * the bots are difficulty.c's random policy, since the dodging one looks
+ * through the enemies' row lists, which the lanes don't keep
+ *
+ * the copy is checked against the real thing: -c plays each lane's game with
+ * a plain scalar version of the same logic and with game_update itself, and
+ * fails at the first step where any of the three disagree, after checking
+ * the vector xorshift against xorshift.s's C version
+ *
+ * the lanes are GCC vector types, so the compiler picks the instructions,
+ * and there are as many as fit in a register: 4 with plain SSE2, 8 with
+ * -mavx2 and 16 with -mavx512f
+ *
+ * build: cc -O2 -mavx2 -DPLATFORM_HOST -no-pie -pthread -o lockstep \
+ *            tools/lockstep.c platform_host.c ppu.c
+ *
+ * without -c it plays the same games in lanes, with the scalar version and
+ * with game_update, and prints how many steps a second each managed
+ *
+ * usage: lockstep [-c] [-n games] [-m steps]
+ *   -c  check the lanes against the scalar version and game_update
+ *   -n  how many games to play, or check (default 100000, or 1000 with -c)
+ *   -m  end a game that lasts this many steps (default 36000, 10 minutes) */
+
+#define DEFENDER_NO_MAIN
+#include "../main.c"
+
+#include <string.h>
+#include <time.h>
+
+/* as many games as fit in one vector register */
+#ifndef LANES
+#if defined(__AVX512F__)
+#define LANES 16
+#elif defined(__AVX2__)
+#define LANES 8
+#else
+#define LANES 4
+#endif
+#endif
+
+typedef int Lanes __attribute__((vector_size(LANES * 4)));
+typedef unsigned int ULanes __attribute__((vector_size(LANES * 4)));
+typedef unsigned long long WideLanes __attribute__((vector_size(LANES * 8)));
+
+/* where player_init and game_init start a game - the check catches these
+ * falling out of step with main.c */
+#define PLAYER_X (100 << 8)
+#define PLAYER_Y (113 << 8)
+#define PLAYER_BORDER 32
+
+/* comparisons give -1 in the lanes where they're true, so they work as
+ * masks for picking between two values */
+static inline Lanes pick(Lanes mask, Lanes yes, Lanes no) {
+    return (yes & mask) | (no & ~mask);
+}
+
+static inline int any(Lanes mask) {
+    int result = 0;
+    for (int lane = 0; lane < LANES; lane++) {
+        result |= mask[lane];
+    }
+    return result;
+}
+
+/* xorshift.s in every lane at once */
+static inline ULanes xorshift_lanes(ULanes x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/* random_range in the lanes of mask, leaving the other lanes' seeds be -
+ * lanes that land in the uneven part draw again, as in fastdiv.h */
+static inline Lanes random_range_lanes(ULanes* seed, Lanes mask, unsigned int range) {
+    unsigned int threshold = (0u - range) % range;
+    Lanes result = {0};
+
+    while (any(mask)) {
+        ULanes next = xorshift_lanes(*seed);
+        *seed = (ULanes) pick(mask, (Lanes) next, (Lanes) *seed);
+
+        WideLanes product = __builtin_convertvector(*seed, WideLanes) * range;
+        ULanes high = __builtin_convertvector(product >> 32, ULanes);
+        ULanes low = __builtin_convertvector(product, ULanes);
+
+        result = pick(mask, (Lanes) high, result);
+        mask &= low < threshold;
+    }
+    return result;
+}
+
+/* the buttons each game's bot holds: a random direction, or nothing, for a
+ * random while - the same as difficulty.c's random policy */
+struct Bot {
+    unsigned int seed;
+    unsigned short held;
+    int left;
+};
+
+unsigned short bot_buttons(struct Bot* bot) {
+    static const unsigned short moves[] = {
+        0, BUTTON_LEFT, BUTTON_RIGHT, BUTTON_UP, BUTTON_DOWN,
+        BUTTON_LEFT | BUTTON_UP, BUTTON_LEFT | BUTTON_DOWN,
+        BUTTON_RIGHT | BUTTON_UP, BUTTON_RIGHT | BUTTON_DOWN
+    };
+
+    if (bot->left-- <= 0) {
+        bot->held = moves[random_range(&bot->seed, 9)];
+        bot->left = 8 + random_range(&bot->seed, 56);
+    }
+    return bot->held;
+}
+
+/* the player moving, as player_left, player_right and so on do, returning
+ * how far the screen scrolled */
+int player_move(int* x, int* y, unsigned short pressed) {
+    int scrolled = 0;
+
+    if (pressed & BUTTON_RIGHT) {
+        if (is_player_right_border(*x, PLAYER_BORDER, SCREEN_WIDTH)) {
+            scrolled += 2;
+        } else {
+            *x += 256 * 2;
+        }
+    }
+    if (pressed & BUTTON_LEFT) {
+        if ((*x >> 8) < PLAYER_BORDER) {
+            scrolled -= 2;
+        } else {
+            *x -= 256 * 2;
+        }
+    }
+    if ((pressed & BUTTON_DOWN) && *y < SCREEN_HEIGHT * FIXED8(0.75)) {
+        *y += 256 * 2;
+    }
+    if ((pressed & BUTTON_UP) && (*y >> 8) > 0) {
+        *y -= 256 * 2;
+    }
+    return scrolled;
+}
+
+/* LANES games going at once, each lane starting a new game as soon as its
+ * last one ends, so none of them sit idle waiting for the slowest */
+struct Batch {
+    Lanes x[MAX_ENEMIES];       /* 8.8 fixed point */
+    Lanes y[MAX_ENEMIES];       /* whole pixels */
+    ULanes seed;
+    Lanes player_x, player_y, xscroll;
+    Lanes count, difficulty;
+    Lanes vblank_counter, next_spawn;
+    ULanes bot_seed;
+    Lanes held, left;           /* the bots, as struct Bot */
+    Lanes playing;              /* -1 while a lane has a game going */
+    int most;                   /* the most enemies in any lane playing */
+};
+
+/* lanes with fewer enemies than the most just sit out the rest, so that's
+ * how far the enemy loop runs */
+void batch_most(struct Batch* batch) {
+    batch->most = 0;
+    for (int lane = 0; lane < LANES; lane++) {
+        if (batch->playing[lane] && batch->count[lane] > batch->most) {
+            batch->most = batch->count[lane];
+        }
+    }
+}
+
+/* start a game in one lane, as game_init and player_init do */
+void batch_start(struct Batch* batch, int lane, unsigned int seed) {
+    batch->seed[lane] = seed;
+    batch->player_x[lane] = PLAYER_X;
+    batch->player_y[lane] = PLAYER_Y;
+    batch->xscroll[lane] = 0;
+    batch->vblank_counter[lane] = 0;
+    batch->next_spawn[lane] = SPAWN_INTERVAL;
+    batch->bot_seed[lane] = seed ^ 0x5bd1e995;
+    batch->held[lane] = 0;
+    batch->left[lane] = 0;
+    batch->playing[lane] = -1;
+
+    /* the first enemy, in the top left */
+    batch->x[0][lane] = 0;
+    batch->y[0][lane] = 0;
+    batch->count[lane] = 1;
+    batch->difficulty[lane] = 1;
+    batch_most(batch);
+}
+
+/* one step of every game, as game_update does it - returns the lanes whose
+ * games ended, from the player being hit or lasting max_steps */
+Lanes batch_step(struct Batch* batch, int max_steps) {
+    static const unsigned short moves[] = {
+        0, BUTTON_LEFT, BUTTON_RIGHT, BUTTON_UP, BUTTON_DOWN,
+        BUTTON_LEFT | BUTTON_UP, BUTTON_LEFT | BUTTON_DOWN,
+        BUTTON_RIGHT | BUTTON_UP, BUTTON_RIGHT | BUTTON_DOWN
+    };
+    Lanes playing = batch->playing;
+
+    /* the bots pick new buttons when they've held the last ones long enough */
+    Lanes renew = (batch->left <= 0) & playing;
+    batch->left -= 1;
+    if (any(renew)) {
+        Lanes move = random_range_lanes(&batch->bot_seed, renew, 9);
+        Lanes chosen;
+        for (int lane = 0; lane < LANES; lane++) {
+            chosen[lane] = moves[move[lane]];
+        }
+        batch->held = pick(renew, chosen, batch->held);
+        batch->left = pick(renew, 8 + random_range_lanes(&batch->bot_seed, renew, 56), batch->left);
+    }
+
+    /* the player moving, as player_move does */
+    Lanes held = batch->held & playing;
+    Lanes right = (held & BUTTON_RIGHT) != 0;
+    Lanes border = (Lanes) ((ULanes) batch->player_x >> 8) > SCREEN_WIDTH - 16 - PLAYER_BORDER;
+    Lanes scrolled = right & border & 2;
+    batch->player_x += right & ~border & (256 * 2);
+
+    Lanes left = (held & BUTTON_LEFT) != 0;
+    border = (batch->player_x >> 8) < PLAYER_BORDER;
+    scrolled -= left & border & 2;
+    batch->player_x -= left & ~border & (256 * 2);
+
+    Lanes down = ((held & BUTTON_DOWN) != 0) & (batch->player_y < SCREEN_HEIGHT * FIXED8(0.75));
+    batch->player_y += down & (256 * 2);
+    Lanes up = ((held & BUTTON_UP) != 0) & ((batch->player_y >> 8) > 0);
+    batch->player_y -= up & (256 * 2);
+    batch->xscroll += scrolled;
+
+    /* enemies drift back while the screen scrolls right */
+    Lanes step = pick(scrolled > 0, 256 * batch->count - 384, 256 * (batch->count + 1));
+
+    /* the rows the player can be hit from, as enemy_find_near works out */
+    Lanes px = batch->player_x >> 8, py = batch->player_y >> 8;
+    Lanes first = (py - 8 + 7) >> 3, last = (py + 8) >> 3;
+    first &= first > 0;
+    last = pick(last < ENEMY_ROWS, last, (Lanes) {0} + ENEMY_ROWS - 1);
+
+    Lanes hit = {0};
+    for (int i = 0; i < batch->most; i++) {
+        Lanes active = (i < batch->count) & playing;
+        Lanes x = batch->x[i] + step;
+
+        /* start over on a random row at the left side */
+        Lanes wrap = ((x >> 8) >= SCREEN_WIDTH) & active;
+        if (any(wrap)) {
+            Lanes row = random_range_lanes(&batch->seed, wrap, ENEMY_ROWS);
+            batch->y[i] = pick(wrap, row * 8, batch->y[i]);
+            x &= ~wrap;
+        }
+        batch->x[i] = x;
+
+        Lanes row = batch->y[i] >> 3;
+        ULanes dx = (ULanes) ((x >> 8) - px + 16);
+        hit |= active & (row >= first) & (row <= last) & (Lanes) (dx <= 32);
+    }
+
+    /* waves are rare enough to spawn a lane at a time */
+    Lanes due = (batch->vblank_counter == batch->next_spawn) & playing;
+    if (any(due)) {
+        for (int lane = 0; lane < LANES; lane++) {
+            if (!due[lane]) {
+                continue;
+            }
+            batch->next_spawn[lane] += SPAWN_INTERVAL;
+            if (batch->count[lane] >= MAX_ENEMIES) {
+                continue;
+            }
+
+            unsigned int seed = batch->seed[lane];
+            for (int k = 0; k < batch->difficulty[lane] && batch->count[lane] < MAX_ENEMIES; k++) {
+                int row = random_range(&seed, ENEMY_ROWS);
+                int i = batch->count[lane]++;
+                batch->x[i][lane] = -(int) (seed & 31) * 256;
+                batch->y[i][lane] = row * 8;
+            }
+            batch->seed[lane] = seed;
+            batch->difficulty[lane] *= SPAWN_GROWTH;
+        }
+    }
+
+    batch->vblank_counter -= playing;
+    Lanes ended = (hit | (batch->vblank_counter >= max_steps)) & playing;
+    batch->playing &= ~ended;
+    if (any(due | ended)) {
+        batch_most(batch);
+    }
+    return ended;
+}
+
+/* the same step for a single game, written plainly, as the reference the
+ * lanes are checked against */
+struct Single {
+    int x[MAX_ENEMIES], y[MAX_ENEMIES];
+    unsigned int seed;
+    int player_x, player_y, xscroll;
+    int done, count, difficulty;
+    unsigned int vblank_counter, next_spawn;
+    struct Bot bot;
+};
+
+void single_init(struct Single* single, unsigned int seed) {
+    memset(single, 0, sizeof(*single));
+    single->seed = seed;
+    single->player_x = PLAYER_X;
+    single->player_y = PLAYER_Y;
+    single->bot.seed = seed ^ 0x5bd1e995;
+    single->count = 1;
+    single->difficulty = 1;
+    single->next_spawn = SPAWN_INTERVAL;
+}
+
+void single_step(struct Single* single) {
+    int scrolled = player_move(&single->player_x, &single->player_y, bot_buttons(&single->bot));
+    single->xscroll += scrolled;
+    int step = scrolled > 0 ? 256 * single->count - 384 : 256 * (single->count + 1);
+
+    int px = single->player_x >> 8, py = single->player_y >> 8;
+    for (int i = 0; i < single->count; i++) {
+        int x = single->x[i] + step;
+        if ((x >> 8) >= SCREEN_WIDTH) {
+            single->y[i] = random_range(&single->seed, ENEMY_ROWS) * 8;
+            x = 0;
+        }
+        single->x[i] = x;
+
+        int dx = (x >> 8) - px, dy = single->y[i] - py;
+        if (dx >= -16 && dx <= 16 && dy >= -8 && dy <= 8) {
+            single->done = 1;
+        }
+    }
+
+    if (single->vblank_counter == single->next_spawn) {
+        single->next_spawn += SPAWN_INTERVAL;
+        if (single->count < MAX_ENEMIES) {
+            for (int k = 0; k < single->difficulty && single->count < MAX_ENEMIES; k++) {
+                int row = random_range(&single->seed, ENEMY_ROWS);
+                single->x[single->count] = -(int) (single->seed & 31) * 256;
+                single->y[single->count] = row * 8;
+                single->count++;
+            }
+            single->difficulty *= SPAWN_GROWTH;
+        }
+    }
+    single->vblank_counter++;
+}
+
+/* a game's seed from its number, never 0 */
+unsigned int game_seed(unsigned long game) {
+    unsigned long long z = 1 + game * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (unsigned int) (z ^ (z >> 31)) | 1;
+}
+
+double now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+/* the vector xorshift against the scalar one, over a long run of seeds */
+int check_xorshift() {
+    ULanes lanes;
+    unsigned int seeds[LANES];
+    for (int lane = 0; lane < LANES; lane++) {
+        seeds[lane] = lanes[lane] = game_seed(lane);
+    }
+
+    for (int i = 0; i < 1000000; i++) {
+        lanes = xorshift_lanes(lanes);
+        for (int lane = 0; lane < LANES; lane++) {
+            xorshift(&seeds[lane]);
+            if (lanes[lane] != seeds[lane]) {
+                fprintf(stderr, "xorshift: lane %d differs after %d steps\n", lane, i + 1);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* one game played the plain way and by game_update, to hold a lane to */
+struct Reference {
+    unsigned long number;
+    struct Single single;
+    struct Game game;
+    struct Enemies enemies;
+    struct Bot bot;
+};
+
+void reference_start(struct Reference* reference, unsigned long number) {
+    unsigned int seed = game_seed(number);
+    reference->number = number;
+    single_init(&reference->single, seed);
+
+    /* the real games all share main.c's globals, so each one's enemies are
+     * kept aside between its steps */
+    game_init(&reference->game, 0);
+    reference->game.seed = seed;
+    reference->enemies = enemies;
+    reference->bot = reference->single.bot;
+}
+
+/* play games every way at once, comparing them after every step */
+int check_games(unsigned long games, int max_steps) {
+    static struct Batch batch;
+    static struct Reference references[LANES];
+    unsigned long next = 0;
+
+    for (int lane = 0; lane < LANES && next < games; lane++, next++) {
+        batch_start(&batch, lane, game_seed(next));
+        reference_start(&references[lane], next);
+    }
+
+    while (any(batch.playing)) {
+        Lanes playing = batch.playing;
+        Lanes ended = batch_step(&batch, max_steps);
+
+        for (int lane = 0; lane < LANES; lane++) {
+            if (!playing[lane]) {
+                continue;
+            }
+            struct Reference* reference = &references[lane];
+            struct Single* single = &reference->single;
+            struct Game* game = &reference->game;
+
+            single_step(single);
+            enemies = reference->enemies;
+            platform_set_buttons(bot_buttons(&reference->bot));
+            game_update(game);
+            game->vblank_counter++;
+            reference->enemies = enemies;
+
+            int same = single->done == game->done &&
+                single->seed == rng_last(&game->rng) && single->seed == batch.seed[lane] &&
+                single->player_x == game->player.x && single->player_x == batch.player_x[lane] &&
+                single->player_y == game->player.y && single->player_y == batch.player_y[lane] &&
+                single->xscroll == game->xscroll && single->xscroll == batch.xscroll[lane] &&
+                single->count == enemies.count && single->count == batch.count[lane];
+            for (int i = 0; same && i < single->count; i++) {
+                same = single->x[i] == enemies.x[i] && single->x[i] == batch.x[i][lane] &&
+                    single->y[i] == enemies.y[i] && single->y[i] == batch.y[i][lane];
+            }
+
+            /* and they all end on the same step */
+            int over = single->done || single->vblank_counter >= (unsigned int) max_steps;
+            if (!same || over != -ended[lane]) {
+                fprintf(stderr, "game %lu (seed %#x) differs at step %u\n",
+                        reference->number, game_seed(reference->number), single->vblank_counter);
+                return 0;
+            }
+
+            if (over && next < games) {
+                batch_start(&batch, lane, game_seed(next));
+                reference_start(reference, next++);
+            }
+        }
+    }
+    return 1;
+}
+
+/* play the games in lanes, returning how many steps they took */
+unsigned long long play_lanes(unsigned long games, int max_steps) {
+    static struct Batch batch;
+    unsigned long long steps = 0;
+    unsigned long next = 0;
+
+    for (int lane = 0; lane < LANES && next < games; lane++) {
+        batch_start(&batch, lane, game_seed(next++));
+    }
+
+    while (any(batch.playing)) {
+        Lanes ended = batch_step(&batch, max_steps);
+        if (!any(ended)) {
+            continue;
+        }
+        for (int lane = 0; lane < LANES; lane++) {
+            if (ended[lane]) {
+                steps += batch.vblank_counter[lane];
+                if (next < games) {
+                    batch_start(&batch, lane, game_seed(next++));
+                }
+            }
+        }
+    }
+    return steps;
+}
+
+/* the same games one at a time, with the plain version */
+unsigned long long play_single(unsigned long games, int max_steps) {
+    static struct Single single;
+    unsigned long long steps = 0;
+
+    for (unsigned long game = 0; game < games; game++) {
+        single_init(&single, game_seed(game));
+        while (!single.done && single.vblank_counter < (unsigned int) max_steps) {
+            single_step(&single);
+        }
+        steps += single.vblank_counter;
+    }
+    return steps;
+}
+
+/* and with game_update, as tools/difficulty.c plays them */
+unsigned long long play_game(unsigned long games, int max_steps) {
+    unsigned long long steps = 0;
+
+    for (unsigned long number = 0; number < games; number++) {
+        struct Game game;
+        struct Bot bot;
+        game_init(&game, 0);
+        game.seed = game_seed(number);
+        bot = (struct Bot) {game.seed ^ 0x5bd1e995, 0, 0};
+
+        while (!game.done && game.vblank_counter < (unsigned int) max_steps) {
+            platform_set_buttons(bot_buttons(&bot));
+            game_update(&game);
+            game.vblank_counter++;
+        }
+        steps += game.vblank_counter;
+    }
+    return steps;
+}
+
+int main(int argc, char** argv) {
+    int check = 0, max_steps = 36000;
+    unsigned long games = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            check = 1;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            games = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            max_steps = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-c] [-n games] [-m steps]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (games == 0) {
+        games = check ? 1000 : 100000;
+    }
+
+    if (check) {
+        if (!check_xorshift() || !check_games(games, max_steps)) {
+            return 1;
+        }
+        fprintf(stderr, "%lu games the same all three ways\n", games);
+        return 0;
+    }
+
+    printf("# way\tgames\tsteps\tsteps/s\n");
+    const char* names[] = {"lanes", "scalar", "game"};
+    unsigned long long (*plays[])(unsigned long, int) = {play_lanes, play_single, play_game};
+    double rates[3];
+    unsigned long long steps[3];
+
+    for (int i = 0; i < 3; i++) {
+        double start = now_ns();
+        steps[i] = plays[i](games, max_steps);
+        rates[i] = steps[i] / (now_ns() - start) * 1e9;
+        printf("%s\t%lu\t%llu\t%.0f\n", names[i], games, steps[i], rates[i]);
+    }
+
+    fprintf(stderr, "%d lanes: %.1fx the steps a second of the scalar version, %.1fx game_update's\n",
+            LANES, rates[0] / rates[1], rates[0] / rates[2]);
+
+    /* the games are the same every way, so they have to last as long */
+    return steps[0] != steps[1] || steps[0] != steps[2];
+}
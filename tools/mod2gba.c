@@ -0,0 +1,234 @@
+/* mod2gba.c
+ * converts a 4 channel ProTracker module (M.K.) into a header holding a
+ * struct Song (see song.h) for the game's music player
+ *
+ * only the instruments and patterns the song actually uses are kept, notes
+ * are turned from Amiga periods into note numbers, and the samples are kept
+ * as they are - 8 bit signed, played back at the pitch of each note
+ *
+ * usage: mod2gba input.mod name > output.h
+ *
+ * modules with no orders, or where none of the instruments played have any
+ * samples, are refused rather than turned into empty arrays
+ *
+ * build: cc -O2 -o mod2gba tools/mod2gba.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../song.h"
+
+#define MOD_INSTRUMENTS 31
+#define MOD_ORDERS 128
+#define MOD_HEADER 1084
+
+/* the Amiga periods of notes C-1 to B-3 */
+static const int periods[36] = {
+    856, 808, 762, 720, 678, 640, 604, 570, 538, 508, 480, 453,
+    428, 404, 381, 360, 339, 320, 302, 285, 269, 254, 240, 226,
+    214, 202, 190, 180, 170, 160, 151, 143, 135, 127, 120, 113
+};
+
+/* the note number (1 to 36) with the nearest period, or 0 for none */
+int period_note(int period) {
+    if (period == 0) {
+        return 0;
+    }
+
+    int best = 0;
+    for (int i = 1; i < 36; i++) {
+        if (abs(periods[i] - period) < abs(periods[best] - period)) {
+            best = i;
+        }
+    }
+    return best + 1;
+}
+
+/* big endian 16 bit word */
+int word(const unsigned char* bytes) {
+    return (bytes[0] << 8) | bytes[1];
+}
+
+/* print an array of bytes, 12 to a line like the other generated headers */
+void print_bytes(const char* type, const char* name, const char* suffix,
+        const unsigned char* bytes, int count) {
+    printf("const %s %s_%s [] = {\n", type, name, suffix);
+    for (int i = 0; i < count; i++) {
+        if (i % 12 == 0) {
+            printf("    ");
+        }
+        printf("0x%02X%s", bytes[i], i == count - 1 ? "" : ", ");
+        if (i % 12 == 11 || i == count - 1) {
+            printf("\n");
+        }
+    }
+    printf("};\n\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s input.mod name > output.h\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char* mod = malloc(size);
+    if (size < MOD_HEADER || fread(mod, 1, size, file) != (size_t) size) {
+        fprintf(stderr, "%s: too short to be a module\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+
+    if (memcmp(mod + 1080, "M.K.", 4) != 0 && memcmp(mod + 1080, "M!K!", 4) != 0) {
+        fprintf(stderr, "%s: only 4 channel M.K. modules are supported\n", argv[1]);
+        return 1;
+    }
+
+    const char* name = argv[2];
+    int order_count = mod[950];
+    const unsigned char* orders = mod + 952;
+    if (order_count == 0 || order_count > MOD_ORDERS) {
+        fprintf(stderr, "%s: the song has %d orders\n", argv[1], order_count);
+        return 1;
+    }
+
+    /* the stored patterns go up to the highest one in the order table */
+    int stored_patterns = 0;
+    for (int i = 0; i < MOD_ORDERS; i++) {
+        if (orders[i] + 1 > stored_patterns) {
+            stored_patterns = orders[i] + 1;
+        }
+    }
+    const unsigned char* pattern_data = mod + MOD_HEADER;
+    const unsigned char* sample_data = pattern_data + stored_patterns * SONG_PATTERN_BYTES;
+
+    /* find the patterns and instruments which get played */
+    int pattern_map[256], used_patterns = 0;
+    int instrument_map[MOD_INSTRUMENTS + 1] = {0}, used_instruments = 0;
+    memset(pattern_map, -1, sizeof(pattern_map));
+    for (int i = 0; i < order_count; i++) {
+        int pattern = orders[i];
+        if (pattern_map[pattern] >= 0) {
+            continue;
+        }
+        pattern_map[pattern] = used_patterns++;
+
+        for (int cell = 0; cell < SONG_ROWS * SONG_CHANNELS; cell++) {
+            const unsigned char* bytes = pattern_data + pattern * SONG_PATTERN_BYTES + cell * 4;
+            int instrument = (bytes[0] & 0xf0) | (bytes[2] >> 4);
+            if (instrument && instrument <= MOD_INSTRUMENTS && !instrument_map[instrument]) {
+                instrument_map[instrument] = ++used_instruments;
+            }
+        }
+    }
+
+    /* the used instruments' samples, one after the other */
+    unsigned char* data = NULL;
+    int data_size = 0;
+    struct SongInstrument instruments[MOD_INSTRUMENTS];
+    const unsigned char* samples = sample_data;
+    for (int i = 1; i <= MOD_INSTRUMENTS; i++) {
+        const unsigned char* header = mod + 20 + (i - 1) * 30;
+        int length = word(header + 22) * 2;
+        int loop_start = word(header + 26) * 2;
+        int loop_length = word(header + 28) * 2;
+
+        if (samples + length > mod + size) {
+            fprintf(stderr, "%s: instrument %d runs past the end of the file\n", argv[1], i);
+            return 1;
+        }
+
+        if (instrument_map[i]) {
+            struct SongInstrument* instrument = &instruments[instrument_map[i] - 1];
+
+            /* a loop of 2 bytes or less means no loop, otherwise nothing
+             * past the end of the loop is ever played */
+            if (loop_length > 2 && loop_start + loop_length <= length) {
+                length = loop_start + loop_length;
+            } else {
+                loop_length = 0;
+            }
+
+            instrument->offset = data_size;
+            instrument->length = length;
+            instrument->loop_length = loop_length;
+            instrument->volume = header[25] > 64 ? 64 : header[25];
+
+            data = realloc(data, data_size + length);
+            memcpy(data + data_size, samples, length);
+            data_size += length;
+        }
+        samples += word(header + 22) * 2;
+    }
+
+    /* a song that plays nothing would be an empty array, which isn't C, and
+     * is almost certainly the wrong file */
+    if (data_size == 0) {
+        fprintf(stderr, "%s: none of the instruments the song plays have samples\n", argv[1]);
+        return 1;
+    }
+
+    /* the used patterns, with periods turned into notes */
+    int patterns_size = used_patterns * SONG_PATTERN_BYTES;
+    unsigned char* patterns = malloc(patterns_size);
+    for (int pattern = 0; pattern < 256; pattern++) {
+        if (pattern_map[pattern] < 0) {
+            continue;
+        }
+
+        for (int cell = 0; cell < SONG_ROWS * SONG_CHANNELS; cell++) {
+            const unsigned char* bytes = pattern_data + pattern * SONG_PATTERN_BYTES + cell * 4;
+            unsigned char* out = patterns + pattern_map[pattern] * SONG_PATTERN_BYTES + cell * 4;
+            int instrument = (bytes[0] & 0xf0) | (bytes[2] >> 4);
+
+            out[0] = period_note(((bytes[0] & 0x0f) << 8) | bytes[1]);
+            out[1] = instrument <= MOD_INSTRUMENTS ? instrument_map[instrument] : 0;
+            out[2] = bytes[2] & 0x0f;
+            out[3] = bytes[3];
+
+            /* a jump past the end of the song goes back to the start */
+            if (out[2] == SONG_EFFECT_JUMP && out[3] >= order_count) {
+                out[3] = 0;
+            }
+        }
+    }
+
+    unsigned char new_orders[MOD_ORDERS];
+    for (int i = 0; i < order_count; i++) {
+        new_orders[i] = pattern_map[orders[i]];
+    }
+
+    fprintf(stderr, "%s: %d orders, %d patterns, %d instruments, %d bytes of samples\n",
+            argv[1], order_count, used_patterns, used_instruments, data_size);
+
+    printf("/* %s.h\n * generated by mod2gba from %s */\n\n", name, argv[1]);
+    printf("#include \"song.h\"\n\n");
+    print_bytes("signed char", name, "data", data, data_size);
+    print_bytes("unsigned char", name, "orders", new_orders, order_count);
+    print_bytes("unsigned char", name, "patterns", patterns, patterns_size);
+
+    printf("const struct SongInstrument %s_instruments [] = {\n", name);
+    for (int i = 0; i < used_instruments; i++) {
+        printf("    {%u, %u, %u, %u},\n", instruments[i].offset, instruments[i].length,
+                instruments[i].loop_length, instruments[i].volume);
+    }
+    printf("};\n\n");
+
+    printf("const struct Song %s = {\n", name);
+    printf("    %s_data, %s_instruments, %s_orders, %s_patterns,\n", name, name, name, name);
+    printf("    %d, 6, 125\n", order_count);
+    printf("};\n\n");
+
+    free(mod);
+    free(data);
+    free(patterns);
+    return 0;
+}
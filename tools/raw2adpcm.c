@@ -0,0 +1,168 @@
+/* raw2adpcm.c
+ * converts an 8 bit signed sound into IMA ADPCM for the game, as a header
+ * like the ones raw2gba makes
+ *
+ * the input is either a raw file of signed 8 bit samples, or a header made
+ * by raw2gba (anything ending in .h), in which case the bytes between the
+ * first { and } are used
+ *
+ * usage: raw2adpcm input name > output.h
+ *  e.g.: raw2adpcm music.h music_adpcm > music_adpcm.h
+ *
+ * build: cc -O2 -o raw2adpcm tools/raw2adpcm.c -lm */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../adpcm.h"
+
+/* the most any decoded sample may be off by, in 8 bit steps - the
+ * conversion fails rather than produce something noisier than this */
+#define MAX_ERROR 16
+
+/* how many samples ahead the encoder looks when picking each nibble */
+#define LOOKAHEAD 2
+
+/* the smallest total squared error reachable over the next depth samples
+ * starting from state, for the 8 bit samples given */
+long long best_error(struct AdpcmState state, const signed char* samples, int depth) {
+    if (depth == 0) {
+        return 0;
+    }
+
+    long long best = -1;
+    for (int nibble = 0; nibble < 16; nibble++) {
+        struct AdpcmState trial = state;
+        long long error = (adpcm_decode(&trial, nibble) >> 8) - samples[0];
+        error = error * error + best_error(trial, samples + 1, depth - 1);
+        if (best < 0 || error < best) {
+            best = error;
+        }
+    }
+    return best;
+}
+
+/* read the whole input, returns the number of samples */
+int read_samples(const char* filename, signed char** samples) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        perror(filename);
+        exit(1);
+    }
+
+    int capacity = 1 << 16, count = 0;
+    *samples = malloc(capacity);
+
+    int header = strlen(filename) > 2 && strcmp(filename + strlen(filename) - 2, ".h") == 0;
+    if (header) {
+        /* skip to the array and read each number in it */
+        int c;
+        while ((c = fgetc(file)) != EOF && c != '{') { }
+
+        int value;
+        while (fscanf(file, " %i ,", &value) == 1) {
+            if (count == capacity) {
+                capacity *= 2;
+                *samples = realloc(*samples, capacity);
+            }
+            (*samples)[count++] = (signed char) value;
+        }
+    } else {
+        int c;
+        while ((c = fgetc(file)) != EOF) {
+            if (count == capacity) {
+                capacity *= 2;
+                *samples = realloc(*samples, capacity);
+            }
+            (*samples)[count++] = (signed char) c;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s input name > output.h\n", argv[0]);
+        return 1;
+    }
+
+    signed char* samples;
+    int count = read_samples(argv[1], &samples);
+    if (count == 0) {
+        fprintf(stderr, "%s: no samples found\n", argv[1]);
+        return 1;
+    }
+
+    int bytes = (count + 1) / 2;
+    unsigned char* encoded = calloc(bytes, 1);
+
+    struct AdpcmState state = {0, 0};
+    int max_error = 0;
+    double total_error = 0;
+
+    for (int i = 0; i < count; i++) {
+        /* aim for the middle of the 8 bit sample, since decoding shifts the
+         * bottom 8 bits away */
+        int target = samples[i] * 256 + 128;
+
+        /* try every nibble, looking a few samples ahead to see which one
+         * leaves the step size best placed for what's coming, and break
+         * ties by which lands closest now */
+        int depth = count - i - 1 < LOOKAHEAD ? count - i - 1 : LOOKAHEAD;
+        int best = 0;
+        long long best_total = -1;
+        int best_distance = 0;
+        for (int nibble = 0; nibble < 16; nibble++) {
+            struct AdpcmState trial = state;
+            int decoded = adpcm_decode(&trial, nibble);
+            long long error = (decoded >> 8) - samples[i];
+            long long total = error * error + best_error(trial, samples + i + 1, depth);
+            int distance = abs(decoded - target);
+            if (best_total < 0 || total < best_total ||
+                    (total == best_total && distance < best_distance)) {
+                best = nibble;
+                best_total = total;
+                best_distance = distance;
+            }
+        }
+
+        int decoded = adpcm_decode(&state, best) >> 8;
+        encoded[i / 2] |= (i & 1) ? best << 4 : best;
+
+        int error = abs(decoded - samples[i]);
+        if (error > max_error) {
+            max_error = error;
+        }
+        total_error += (double) error * error;
+    }
+
+    fprintf(stderr, "%s: %d samples in %d bytes, max error %d, rms error %.2f\n",
+            argv[1], count, bytes, max_error, count ? sqrt(total_error / count) : 0.0);
+    if (max_error > MAX_ERROR) {
+        fprintf(stderr, "%s: error is over the limit of %d\n", argv[1], MAX_ERROR);
+        return 1;
+    }
+
+    printf("/* %s.h\n * generated by raw2adpcm from %s */\n\n", argv[2], argv[1]);
+    printf("#define %s_samples %d\n", argv[2], count);
+    printf("#define %s_bytes %d\n\n", argv[2], bytes);
+    printf("const unsigned char %s [] = {\n", argv[2]);
+    for (int i = 0; i < bytes; i++) {
+        if (i % 12 == 0) {
+            printf("    ");
+        }
+        printf("0x%02X%s", encoded[i], i == bytes - 1 ? "" : ", ");
+        if (i % 12 == 11 || i == bytes - 1) {
+            printf("\n");
+        }
+    }
+    printf("};\n\n");
+
+    free(samples);
+    free(encoded);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* replay2h.c
+ * converts a recording of the buttons (see replay.h) into a header the game
+ * can be built with, to play it back from ROM on a GBA
+ *
+ * the input is either a recording saved by a host build's DEFENDER_RECORD,
+ * or the save file an emulator or flash cart keeps of the cartridge's SRAM,
+ * which is the recording followed by whatever else was in SRAM
+ *
+ * usage: replay2h input.sav > run.h
+ * then build the game with -DREPLAY_HEADER='"run.h"'
+ *
+ * build: cc -O2 -o replay2h tools/replay2h.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../replay.h"
+
+/* little endian fields */
+unsigned int read16(const unsigned char* bytes) {
+    return bytes[0] | (bytes[1] << 8);
+}
+
+unsigned int read32(const unsigned char* bytes) {
+    return read16(bytes) | (read16(bytes + 2) << 16);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s input.sav > output.h\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+    static unsigned char data[REPLAY_SRAM_BYTES];
+    unsigned int size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+
+    if (size < REPLAY_HEADER_BYTES || memcmp(data, REPLAY_MAGIC, REPLAY_MAGIC_BYTES) != 0) {
+        fprintf(stderr, "%s: not a recording\n", argv[1]);
+        return 1;
+    }
+    unsigned int runs = read32(data + REPLAY_RUNS);
+    if (runs > (size - REPLAY_HEADER_BYTES) / REPLAY_RUN_BYTES) {
+        fprintf(stderr, "%s: has %u runs, but stops short of them\n", argv[1], runs);
+        return 1;
+    }
+
+    /* only what's recorded is kept, not the rest of SRAM */
+    unsigned long steps = 0;
+    for (unsigned int i = 0; i < runs; i++) {
+        steps += read16(data + REPLAY_HEADER_BYTES + i * REPLAY_RUN_BYTES + 2);
+    }
+    size = REPLAY_HEADER_BYTES + runs * REPLAY_RUN_BYTES;
+
+    fprintf(stderr, "%s: seed %#x, %u runs, %lu steps (%.1f s), %u bytes\n",
+            argv[1], read32(data + REPLAY_SEED), runs, steps, steps / 60.0, size);
+
+    printf("/* generated by replay2h from %s */\n\n", argv[1]);
+    printf("const unsigned char replay_data [] = {\n");
+    for (unsigned int i = 0; i < size; i++) {
+        if (i % 12 == 0) {
+            printf("    ");
+        }
+        printf("0x%02X%s", data[i], i == size - 1 ? "" : ", ");
+        if (i % 12 == 11 || i == size - 1) {
+            printf("\n");
+        }
+    }
+    printf("};\n\n");
+    return 0;
+}
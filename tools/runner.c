@@ -0,0 +1,149 @@
+/* runner.c
+ * runs the game on an x86-64 Linux PC with its memory at the same addresses
+ * as on the GBA, so main.c is built just as it is for the GBA, register
+ * pointers and all - platform_host.c (built with PLATFORM_MAPPED) plays the
+ * part of the hardware, moving on a scanline at a time whenever the game
+ * waits for a vblank
+ *
+ * EWRAM, IWRAM, palette, VRAM, OAM and SRAM are plain memory mapped at
+ * their GBA addresses, but the registers are mapped read only there, so the
+ * game's writes to them fault - each one is let through by single stepping
+ * the store, and a write to a DMA control register then starts that channel
+ * the simulated hardware writes the registers through a second, writable
+ * mapping of the same memory, so it doesn't fault on its own writes
+ *
+ * it stops when the player is hit, or after DEFENDER_FRAMES frames, and
+ * prints how fast it ran - DEFENDER_TRACE also works here, and includes the
+ * register stores
+ *
+ * build: cc -O2 -DPLATFORM_MAPPED -no-pie -pthread -Wno-pointer-to-int-cast \
+ *            -o runner tools/runner.c main.c platform_host.c ppu.c */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "../platform.h"
+#include "../trace.h"
+
+#define IO_ADDRESS 0x4000000
+#define PAGE 0x1000
+
+/* the trap flag in EFLAGS, which stops after each instruction */
+#define TRAP_FLAG 0x100
+
+/* which register the store that faulted was writing, what was there
+ * before, and how many have */
+static unsigned int trapped_offset;
+static unsigned char trapped_before[8];
+static unsigned long trapped_writes = 0;
+
+static struct timespec started;
+
+/* a store to the registers: let it through for one instruction */
+static void on_write(int signal, siginfo_t* info, void* context) {
+    unsigned long address = (unsigned long) info->si_addr;
+    ucontext_t* registers = context;
+    (void) signal;
+
+    if (address < IO_ADDRESS || address >= IO_ADDRESS + PAGE) {
+        fprintf(stderr, "runner: bad access at %#lx\n", address);
+        _exit(1);
+    }
+
+    trapped_offset = address - IO_ADDRESS;
+    trapped_writes++;
+    memcpy(trapped_before, platform_io + (trapped_offset & ~7), 8);
+    mprotect((void*) IO_ADDRESS, PAGE, PROT_READ | PROT_WRITE);
+    registers->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+/* the store has happened: catch the next one, trace it, and start DMA if it
+ * was a control register - the high half of each channel's last word */
+static void on_step(int signal, siginfo_t* info, void* context) {
+    ucontext_t* registers = context;
+    (void) signal;
+    (void) info;
+
+    registers->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+    mprotect((void*) IO_ADDRESS, PAGE, PROT_READ);
+
+    /* how wide the store was isn't known, so count the bytes it changed
+     * from where it started, a halfword if it stored the same value */
+    unsigned int start = trapped_offset & 7, bytes = 2;
+    for (unsigned int i = start; i < 8; i++) {
+        if (platform_io[(trapped_offset & ~7) + i] != trapped_before[i]) {
+            unsigned int changed = i - start + 1;
+            bytes = changed <= 2 ? 2 : changed <= 4 ? 4 : 8;
+        }
+    }
+    platform_trace(TRACE_STORE, 0, IO_ADDRESS + trapped_offset, bytes, 1);
+
+    for (int channel = 0; channel < 4; channel++) {
+        unsigned int control = 0xb0 + channel * 12 + 8;
+        if (trapped_offset >= control && trapped_offset < control + 4) {
+            platform_dma_start(channel);
+        }
+    }
+}
+
+/* map a region at its GBA address, failing if anything is already there */
+static void* map(unsigned long address, unsigned long size, int fd, int protection) {
+    int flags = MAP_FIXED_NOREPLACE | (fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED);
+    void* memory = mmap((void*) address, size, protection, flags, fd, 0);
+    if (memory == MAP_FAILED || (address && memory != (void*) address)) {
+        perror("runner: mmap");
+        exit(1);
+    }
+    return memory;
+}
+
+static void report() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+
+    fprintf(stderr, "runner: %u frames in %.2f s, %.0f frames/s, %lu register writes\n",
+            platform_frames, seconds, platform_frames / seconds, trapped_writes);
+}
+
+/* set everything up before main.c's main runs */
+__attribute__((constructor)) static void runner_init() {
+    map(0x2000000, 0x40000, -1, PROT_READ | PROT_WRITE);
+    map(0x3000000, 0x8000, -1, PROT_READ | PROT_WRITE);
+    map(0x5000000, PAGE, -1, PROT_READ | PROT_WRITE);
+    map(0x6000000, 0x18000, -1, PROT_READ | PROT_WRITE);
+    map(0x7000000, PAGE, -1, PROT_READ | PROT_WRITE);
+    map(0xE000000, 0x8000, -1, PROT_READ | PROT_WRITE);
+
+    /* the registers, read only for the game and writable for the hardware */
+    int fd = memfd_create("gba-io", 0);
+    if (fd < 0 || ftruncate(fd, PAGE) < 0) {
+        perror("runner: memfd");
+        exit(1);
+    }
+    map(IO_ADDRESS, PAGE, fd, PROT_READ);
+    platform_io = mmap(NULL, PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (platform_io == MAP_FAILED) {
+        perror("runner: mmap");
+        exit(1);
+    }
+    platform_set_buttons(0);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_flags = SA_SIGINFO;
+    action.sa_sigaction = on_write;
+    sigaction(SIGSEGV, &action, NULL);
+    action.sa_sigaction = on_step;
+    sigaction(SIGTRAP, &action, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    atexit(report);
+}
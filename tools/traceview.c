@@ -0,0 +1,178 @@
+/* traceview.c
+ * summarizes a bus trace from the host build (see trace.h): how many bytes
+ * each frame writes to OAM, VRAM, the palette, the sound hardware and the
+ * other registers, and which writes to the screen happen outside the
+ * vblank, where they can tear what's being drawn
+ *
+ * usage: traceview [-f] trace.bin
+ *   -f  also print the bytes written in every frame, one frame to a line
+ *
+ * it fails if any writes to the screen were outside the vblank, not
+ * counting the first frame, when the game sets everything up, or DMA in
+ * the hblanks, which lands between lines on purpose
+ *
+ * build: cc -O2 -o traceview tools/traceview.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../trace.h"
+
+enum Region {
+    REGION_OAM,
+    REGION_VRAM,
+    REGION_PALETTE,
+    REGION_SOUND,
+    REGION_REGISTERS,
+    REGION_OTHER,
+    REGION_COUNT
+};
+
+const char* region_names[REGION_COUNT] = {
+    "oam", "vram", "palette", "sound", "registers", "other"
+};
+
+enum Region region(unsigned int address) {
+    switch (address >> 24) {
+        case 0x7: return REGION_OAM;
+        case 0x6: return REGION_VRAM;
+        case 0x5: return REGION_PALETTE;
+        case 0x4:
+            /* the sound registers run from 0x60 up to the end of the FIFOs */
+            if ((address & 0x3ff) >= 0x60 && (address & 0x3ff) < 0xa8) {
+                return REGION_SOUND;
+            }
+            return REGION_REGISTERS;
+        default: return REGION_OTHER;
+    }
+}
+
+/* writes which change what's on screen: OAM, VRAM, the palette, and the
+ * display registers, which run up to the blending ones at 0x54 */
+int on_screen(unsigned int address) {
+    enum Region where = region(address);
+    return where == REGION_OAM || where == REGION_VRAM || where == REGION_PALETTE ||
+        (where == REGION_REGISTERS && (address & 0x3ff) < 0x56);
+}
+
+/* the bytes written by the frame being added up */
+unsigned long frame_bytes[REGION_COUNT];
+unsigned long frame_stores;
+
+/* and across the whole trace */
+unsigned long total_bytes[REGION_COUNT];
+unsigned long most_bytes[REGION_COUNT];
+unsigned int most_frame[REGION_COUNT];
+unsigned long total_stores, most_stores;
+unsigned int frames = 0;
+
+void end_frame(unsigned int frame, int print) {
+    if (print) {
+        printf("%u", frame);
+        for (int i = 0; i < REGION_COUNT; i++) {
+            printf("\t%lu", frame_bytes[i]);
+        }
+        printf("\t%lu\n", frame_stores);
+    }
+
+    for (int i = 0; i < REGION_COUNT; i++) {
+        total_bytes[i] += frame_bytes[i];
+        if (frame_bytes[i] > most_bytes[i]) {
+            most_bytes[i] = frame_bytes[i];
+            most_frame[i] = frame;
+        }
+        frame_bytes[i] = 0;
+    }
+
+    total_stores += frame_stores;
+    if (frame_stores > most_stores) {
+        most_stores = frame_stores;
+    }
+    frame_stores = 0;
+    frames++;
+}
+
+int main(int argc, char** argv) {
+    int print = 0;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            print = 1;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [-f] trace.bin\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+            memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not a trace\n", path);
+        return 1;
+    }
+
+    if (print) {
+        printf("# frame");
+        for (int i = 0; i < REGION_COUNT; i++) {
+            printf("\t%s", region_names[i]);
+        }
+        printf("\tstores\n");
+    }
+
+    struct TraceRecord record;
+    unsigned int frame = 0;
+    unsigned long records = 0, torn = 0;
+
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        records++;
+
+        /* frames with nothing written still count */
+        while (frame < record.frame) {
+            end_frame(frame++, print);
+        }
+
+        frame_bytes[region(record.address)] += record.bytes;
+        if (record.kind == TRACE_STORE) {
+            frame_stores++;
+        }
+
+        if (record.frame > 0 && record.line < 160 && record.kind != TRACE_HBLANK &&
+                on_screen(record.address)) {
+            if (torn++ < 20) {
+                fprintf(stderr, "frame %u line %u: %s of %u bytes to %08x outside the vblank\n",
+                        record.frame, record.line,
+                        record.kind == TRACE_STORE ? "store" : "DMA", record.bytes, record.address);
+            }
+        }
+    }
+    end_frame(frame, print);
+    fclose(file);
+
+    fprintf(stderr, "%lu writes over %u frames\n", records, frames);
+    fprintf(stderr, "%-10s %12s %12s %12s\n", "", "bytes/frame", "most", "in frame");
+    for (int i = 0; i < REGION_COUNT; i++) {
+        fprintf(stderr, "%-10s %12.1f %12lu %12u\n", region_names[i],
+                (double) total_bytes[i] / frames, most_bytes[i], most_frame[i]);
+    }
+    fprintf(stderr, "%-10s %12.1f %12lu\n", "stores", (double) total_stores / frames, most_stores);
+
+    if (torn) {
+        fprintf(stderr, "%lu writes to the screen outside the vblank\n", torn);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+/* trace.h
+ * the layout of the bus traces the simulated hardware writes when
+ * DEFENDER_TRACE names a file (see platform_host.c), which
+ * tools/traceview.c reads back
+ *
+ * a trace is TRACE_MAGIC followed by one record for every DMA transfer and,
+ * in tools/runner.c, every store to a register - each says which frame and
+ * scanline it happened on, where it wrote and how many bytes */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_MAGIC "GBATRC1\n"
+
+/* what made the write */
+#define TRACE_STORE 0   /* the CPU storing to a register */
+#define TRACE_DMA 1     /* a DMA channel, each transfer is one record */
+#define TRACE_HBLANK 2  /* a DMA channel started by the hblank, between lines */
+
+struct TraceRecord {
+    unsigned int frame;     /* vblanks since the start */
+    unsigned char line;     /* the scanline, 160 and up are the vblank */
+    unsigned char kind;     /* TRACE_STORE, TRACE_DMA or TRACE_HBLANK */
+    unsigned char channel;  /* which DMA channel, 0 for stores */
+    unsigned char unused;
+    unsigned int address;   /* where the write started */
+    unsigned int bytes;
+};
+
+#endif
@@ -0,0 +1,14 @@
+@ Assembly function which halts the cpu until the next vblank interrupt
+
+.text
+.arm
+.align 2
+.global vblank_intr_wait
+.type vblank_intr_wait, %function
+
+vblank_intr_wait:
+	@ bios call 0x05 is VBlankIntrWait, it sleeps in low power mode and
+	@ returns once the interrupt handler has flagged a new vblank
+	swi 0x050000
+
+	bx lr
@@ -1,5 +1,10 @@
 @ xorshift random number generator
+@ this runs every time an enemy respawns, so it lives in IWRAM as ARM code
+.section .iwram, "ax", %progbits
+.arm
+.align 2
 .global xorshift
+.type xorshift, %function
 xorshift:
         ldr r1, [r0]    @ Load the integer into r1
 
@@ -18,4 +23,57 @@ xorshift:
         @ Store it back
         str r1, [r0]
 
-        mov pc, lr
+        @ bx so this can be called from Thumb code too
+        bx lr
+
+@ xorshift_fill(seed, values, count): count numbers from the same sequence
+@ into values, as calling xorshift count times would - the seed stays in a
+@ register, each number is 3 instructions with the barrel shifter doing
+@ the shifts, and they're made and stored 4 at a time
+.global xorshift_fill
+.type xorshift_fill, %function
+xorshift_fill:
+        stmfd sp!, {r4-r7}
+        ldr r3, [r0]    @ the seed
+
+        subs r2, r2, #4
+        blt .fill_rest
+
+.fill_four:
+        eor r4, r3, r3, lsl #13
+        eor r4, r4, r4, lsr #17
+        eor r4, r4, r4, lsl #5
+
+        eor r5, r4, r4, lsl #13
+        eor r5, r5, r5, lsr #17
+        eor r5, r5, r5, lsl #5
+
+        eor r6, r5, r5, lsl #13
+        eor r6, r6, r6, lsr #17
+        eor r6, r6, r6, lsl #5
+
+        eor r7, r6, r6, lsl #13
+        eor r7, r7, r7, lsr #17
+        eor r7, r7, r7, lsl #5
+
+        stmia r1!, {r4-r7}
+        mov r3, r7
+        subs r2, r2, #4
+        bge .fill_four
+
+.fill_rest:
+        @ the last 0 to 3, one at a time
+        adds r2, r2, #4
+        beq .fill_done
+.fill_one:
+        eor r3, r3, r3, lsl #13
+        eor r3, r3, r3, lsr #17
+        eor r3, r3, r3, lsl #5
+        str r3, [r1], #4
+        subs r2, r2, #1
+        bne .fill_one
+
+.fill_done:
+        str r3, [r0]
+        ldmfd sp!, {r4-r7}
+        bx lr